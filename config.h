@@ -26,6 +26,7 @@
   "syn-string-short.rep", \
   "syn-mix-short.rep", \
   "syn-largemem-short.rep", \
+  "syn-memalign-short.rep", \
   "ngram-fox1.rep", \
   "syn-mix-realloc.rep", \
   "bdd-aa4.rep", \
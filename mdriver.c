@@ -40,6 +40,11 @@
 #define REF_ONLY 0
 #endif
 
+#define BATCH_MAX     64          /* most requests replayed as one batch call */
+#define MAX_FIT_SCANS 16          /* most fit scans compared by -K */
+#define POOL_MAX     512          /* largest request replayed through a pool */
+#define POOL_STEP     16          /* request sizes sharing a pool */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
@@ -80,9 +85,11 @@ typedef struct {
 
 /* Characterizes a single trace operation (allocator request) */
 typedef struct {
-    enum { ALLOC, FREE, REALLOC } type; /* type of request */
+    enum { ALLOC, FREE, REALLOC, MEMALIGN } type; /* type of request */
     long index;                         /* index for free() to use later */
     size_t size;                        /* byte size of alloc/realloc request */
+    size_t alignment;                   /* alignment of a memalign request */
+    int hint;                           /* lifetime hint of an alloc, 0 if none */
 } traceop_t;
 
 /* Holds the information for one trace file */
@@ -95,6 +102,7 @@ typedef struct {
     traceop_t *ops;       /* array of requests */
     char **blocks;        /* array of ptrs returned by malloc/realloc... */
     size_t *block_sizes;  /* ... and a corresponding array of payload sizes */
+    mm_pool_t **block_pools; /* ... and the pool of each, NULL for mm_malloc */
     int *block_rand_base; /* index into random_data, if debug is on */
 } trace_t;
 
@@ -121,6 +129,9 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;       /* space utilization for this trace (always 0 for libc) */
+    size_t peak_heap;  /* largest heap size during the utilization run */
+    size_t final_heap; /* heap size when the utilization run ends */
+    size_t sbrk_calls; /* calls that grew the heap during the utilization run */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -160,6 +171,15 @@ int verbose = REF_ONLY ? 0 : 1;  /* global flag for verbose output */
 static int errors = 0;           /* number of errs found when running student malloc */
 static bool onetime_flag = false;
 static bool tab_mode = false;     /* Print output as tab-separated fields */
+static bool heap_mode = false;    /* Print peak and final heap sizes */
+static bool batch_mode = false;   /* Replay runs of mallocs and frees as batch calls */
+static bool sized_mode = false;   /* Replay frees through mm_free_sized */
+static bool reset_mode = false;   /* Start over with mm_reset rather than mm_init */
+static bool pool_mode = false;    /* Replay small requests through mm_pool_alloc */
+static int lifetime_ops = -1;     /* Hint allocs freed within this many requests short-lived */
+static mm_pool_t *pools[POOL_MAX / POOL_STEP]; /* Pools of the current heap, by size */
+static unsigned fit_scans[MAX_FIT_SCANS]; /* Fit scans to compare, the first is scored */
+static int num_fit_scans = 0;
 static size_t maxfill = MAXFILL;
 
 /* by default, no timeouts */
@@ -207,6 +227,8 @@ static void randomize_block(trace_t *trace, int index);
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
+static int read_hint(FILE *tracefile);
+static void hint_lifetimes(trace_t *trace);
 static void reinit_trace(trace_t *trace);
 static void free_trace(trace_t *trace);
 
@@ -216,12 +238,15 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
-static bool eval_mm_valid(trace_t *trace, range_set_t *ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static bool eval_mm_valid(trace_t *trace, range_set_t *ranges, bool reset);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
 static void eval_mm_speed(void *ptr);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printheaps(int n, stats_t *stats);
+static void printscans(int n, const char *tracedir, char **tracefiles,
+                       stats_t *stats, speed_t *speed_params);
 static void usage(char *prog);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -273,7 +298,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
                 printf("Checking mm_malloc for correctness, ");
             mm_stats[i].valid =
                 /* Do 2 tests, since may fail to reinitialize properly */
-                eval_mm_valid(trace, ranges) && eval_mm_valid(trace, ranges);
+                eval_mm_valid(trace, ranges, false) && eval_mm_valid(trace, ranges, reset_mode);
 
             if (onetime_flag) {
                 free_trace(trace);
@@ -283,7 +308,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
+            mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i]);
             speed_params->trace = trace;
             speed_params->ranges = ranges;
             if (verbose > 1)
@@ -356,7 +381,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDT")) != EOF) {
+    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hOVlDTHBFRPK:L:")) != EOF) {
         switch (c) {
 
             case 'f': /* Use one specific trace file only (relative to curr dir) */
@@ -406,6 +431,42 @@ int main(int argc, char **argv)
                 tab_mode = true;
                 break;
 
+            case 'H':
+                heap_mode = true;
+                break;
+
+            case 'B':
+                batch_mode = true;
+                break;
+
+            case 'F':
+                sized_mode = true;
+                break;
+
+            case 'R':
+                reset_mode = true;
+                break;
+
+            case 'P':
+                pool_mode = true;
+                break;
+
+            case 'L': /* Hint allocs by lifetime, 0 to drop the hints */
+                lifetime_ops = atoi(optarg);
+                if (lifetime_ops < 0)
+                    app_error("-L needs a count of requests, not %s\n", optarg);
+                break;
+
+            case 'K': { /* Comma separated fit scans, e.g. -K 8,1,0 */
+                char *k;
+                for (k = strtok(optarg, ","); k != NULL; k = strtok(NULL, ",")) {
+                    if (num_fit_scans == MAX_FIT_SCANS)
+                        app_error("At most %d fit scans\n", MAX_FIT_SCANS);
+                    fit_scans[num_fit_scans++] = strtoul(k, NULL, 0);
+                }
+                break;
+            }
+
             case 'h': /* Print this message */
                 usage(argv[0]);
                 exit(0);
@@ -427,6 +488,9 @@ int main(int argc, char **argv)
         init_random_data();
     }
 
+    if (num_fit_scans > 0 && mm_fit_scan(0, fit_scans[0]) != 0)
+        app_error("mm_fit_scan rejected a scan of %u\n", fit_scans[0]);
+
     /* Initialize the timeout */
     if (set_timeout > 0) {
         signal(SIGALRM, timeout_handler);
@@ -514,6 +578,17 @@ int main(int argc, char **argv)
             printf("\nResults for mm malloc:\n");
             printresults(num_global_tracefiles, mm_stats, &global_mm_sum_stats);
             printf("\n");
+            if (heap_mode) {
+                printf("Heap sizes for mm malloc:\n");
+                printheaps(num_global_tracefiles, mm_stats);
+                printf("\n");
+            }
+            if (num_fit_scans > 1) {
+                printf("Fit scans for mm malloc:\n");
+                printscans(num_global_tracefiles, tracedir, global_tracefiles,
+                           mm_stats, &speed_params);
+                printf("\n");
+            }
         }
     }
 
@@ -573,10 +648,13 @@ int main(int argc, char **argv)
             avg_mm_throughput = (secs == 0) ? 0 : ops/secs * 0.001;
         }
 
-        p1_checkpoint = score_component(avg_mm_util, MIN_SPACE_CHECKPOINT, MAX_SPACE_CHECKPOINT);
-        p2_checkpoint = score_component(avg_mm_throughput, min_throughput_checkpoint, max_throughput_checkpoint);
+        p1_checkpoint = score_component(avg_mm_util, MIN_SPACE_CHECKPOINT,
+                                        MAX_SPACE_CHECKPOINT);
+        p2_checkpoint = score_component(avg_mm_throughput, min_throughput_checkpoint,
+                                        max_throughput_checkpoint);
 
-        perfindex_checkpoint = (p1_checkpoint * UTIL_WEIGHT + p2_checkpoint * (1.0 - UTIL_WEIGHT)) * 100.0;
+        perfindex_checkpoint = (p1_checkpoint * UTIL_WEIGHT
+                                + p2_checkpoint * (1.0 - UTIL_WEIGHT)) * 100.0;
 
         p1 = score_component(avg_mm_util, MIN_SPACE, MAX_SPACE);
         p2 = score_component(avg_mm_throughput, min_throughput, max_throughput);
@@ -692,15 +770,23 @@ static bool add_range(range_set_t *ranges, char *lo, size_t size,
         return false;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-        (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap or one mapping */
+    if (!mem_in_heap(lo, hi)) {
         malloc_error(trace, opnum,
                      "Payload (%p:%p) lies outside heap (%p:%p)",
                      lo, hi, mem_heap_lo(), mem_heap_hi());
         return false;
     }
 
+    /* The allocator must report at least the requested bytes as usable,
+       pool objects have no block of their own to ask about */
+    if (trace->block_pools[index] == NULL && mm_usable_size(lo) < size) {
+        malloc_error(trace, opnum,
+                     "Payload (%p) reports %zu usable bytes, fewer than %zu",
+                     lo, mm_usable_size(lo), size);
+        return false;
+    }
+
     /* If we can't afford the linear-time loop, we check less thoroughly and
        just assume the overlap will be caught by writing random bits. */
     if (debug_mode == DBG_NONE) return 1;
@@ -875,7 +961,8 @@ static bool check_index(const trace_t *trace, int opnum, int index, int realloc)
         }
     }
     for(i = 0; i < fsize_end; i++) {
-        if (mem_read(&block_end[i], sizeof(randint_t)) != random_data[(base + i) % RANDOM_DATA_LEN]) {
+        if (mem_read(&block_end[i], sizeof(randint_t))
+            != random_data[(base + i) % RANDOM_DATA_LEN]) {
             if (firstgarbled == -1) firstgarbled = i;
             ngarbled++;
         }
@@ -903,7 +990,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     trace_t *trace;
     char type[MAXLINE];
     int index;
-    size_t size;
+    size_t size, alignment;
     int max_index = 0;
     int op_index;
     int ignore = 0;
@@ -934,7 +1021,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
 
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+         (traceop_t *)calloc(trace->num_ops, sizeof(traceop_t))) == NULL)
         unix_error("malloc 2 failed in read_trace");
 
     /* We'll keep an array of pointers to the allocated blocks here... */
@@ -947,6 +1034,11 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          (size_t *)calloc(trace->num_ids,  sizeof(size_t))) == NULL)
         unix_error("malloc 4 failed in read_trace");
 
+    /* ... and the pools they came from in pool mode */
+    if ((trace->block_pools =
+         calloc(trace->num_ids, sizeof(*trace->block_pools))) == NULL)
+        unix_error("malloc 6 failed in read_trace");
+
     /* and, if we're debugging, the offset into the random data */
     if ((trace->block_rand_base =
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
@@ -963,6 +1055,7 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                 trace->ops[op_index].type = ALLOC;
                 trace->ops[op_index].index = index;
                 trace->ops[op_index].size = size;
+                trace->ops[op_index].hint = read_hint(tracefile);
                 max_index = (index > max_index) ? index : max_index;
                 break;
             case 'r':
@@ -972,6 +1065,18 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
                 trace->ops[op_index].size = size;
                 max_index = (index > max_index) ? index : max_index;
                 break;
+            case 'm':
+                ignore += fscanf(tracefile, "%u %lu %lu", &index, &size,
+                                 &alignment);
+                if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+                    app_error("%s: alignment %lu is not a power of two",
+                              trace->filename, alignment);
+                trace->ops[op_index].type = MEMALIGN;
+                trace->ops[op_index].index = index;
+                trace->ops[op_index].size = size;
+                trace->ops[op_index].alignment = alignment;
+                max_index = (index > max_index) ? index : max_index;
+                break;
             case 'f':
                 ignore += fscanf(tracefile, "%u", &index);
                 trace->ops[op_index].type = FREE;
@@ -987,6 +1092,8 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     fclose(tracefile);
     assert(max_index == trace->num_ids - 1);
     assert(trace->num_ops == op_index);
+    if (lifetime_ops >= 0)
+        hint_lifetimes(trace);
 
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
@@ -996,6 +1103,60 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     return trace;
 }
 
+/*
+ * read_hint - Read the optional lifetime hint ending an alloc line, s for
+ *     short-lived and l for long-lived. Returns 0 when there is none.
+ */
+static int read_hint(FILE *tracefile)
+{
+    int c;
+
+    while ((c = getc(tracefile)) == ' ' || c == '\t')
+        ;
+    switch (c) {
+        case 's':
+            return MM_SHORT_LIVED;
+        case 'l':
+            return MM_LONG_LIVED;
+        default:
+            if (c != EOF)
+                ungetc(c, tracefile);
+            return 0;
+    }
+}
+
+/*
+ * hint_lifetimes - Replace the hints of a trace's allocs with what their
+ *     lifetimes are: short-lived when freed within lifetime_ops requests,
+ *     long-lived otherwise. A lifetime_ops of 0 drops every hint.
+ */
+static void hint_lifetimes(trace_t *trace)
+{
+    traceop_t *op;
+    int *freed;
+    int i;
+
+    if ((freed = malloc(trace->num_ids * sizeof(int))) == NULL)
+        unix_error("malloc failed in hint_lifetimes");
+    for (i = 0; i < trace->num_ids; i++)
+        freed[i] = trace->num_ops;
+
+    /* Walk backwards so each alloc sees the next free of its id */
+    for (i = trace->num_ops - 1; i >= 0; i--) {
+        op = &trace->ops[i];
+        if (op->index < 0)
+            continue;
+        if (op->type == FREE)
+            freed[op->index] = i;
+        else if (op->type == ALLOC && lifetime_ops == 0)
+            op->hint = 0;
+        else if (op->type == ALLOC)
+            op->hint = (freed[op->index] - i <= lifetime_ops)
+                       ? MM_SHORT_LIVED : MM_LONG_LIVED;
+    }
+    free(freed);
+}
+
 /*
  * reinit_trace - get the trace ready for another run.
  */
@@ -1003,11 +1164,12 @@ static void reinit_trace(trace_t *trace)
 {
     memset(trace->blocks, 0, trace->num_ids * sizeof(*trace->blocks));
     memset(trace->block_sizes, 0, trace->num_ids * sizeof(*trace->block_sizes));
+    memset(trace->block_pools, 0, trace->num_ids * sizeof(*trace->block_pools));
     /* block_rand_base is unused if size is zero */
 }
 
 /*
- * free_trace - Free the trace record and the four arrays it points
+ * free_trace - Free the trace record and the five arrays it points
  *              to, all of which were allocated in read_trace().
  */
 static void free_trace(trace_t *trace)
@@ -1015,6 +1177,7 @@ static void free_trace(trace_t *trace)
     free(trace->ops);         /* free the three arrays... */
     free(trace->blocks);
     free(trace->block_sizes);
+    free(trace->block_pools);
     free(trace->block_rand_base);
     free(trace);              /* and the trace record itself... */
 }
@@ -1025,24 +1188,171 @@ static void free_trace(trace_t *trace)
  **********************************************************************/
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * batch_len - In batch mode, the number of requests from opnum on that
+ *     go to the mm package as one call: mallocs of a single size, or
+ *     frees of non-null blocks, at most BATCH_MAX. Otherwise 1.
  */
-static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
+static int batch_len(const trace_t *trace, int opnum)
 {
-    int i;
+    const traceop_t *op = &trace->ops[opnum];
+    const traceop_t *next;
+    int n = 1;
+
+    if (!batch_mode || pool_mode || op->type == REALLOC || op->type == MEMALIGN
+        || op->index < 0 || op->hint)
+        return 1;
+    while (n < BATCH_MAX && opnum + n < trace->num_ops) {
+        next = &trace->ops[opnum + n];
+        if (next->type != op->type || next->index < 0 || next->hint
+            || (op->type == ALLOC && next->size != op->size))
+            break;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * batch_malloc - Serve the n mallocs starting at opnum with a single
+ *     mm_malloc_batch call and record the blocks. Returns false if the
+ *     call came up short.
+ */
+static bool batch_malloc(trace_t *trace, int opnum, int n)
+{
+    void *out[BATCH_MAX];
+    size_t size = trace->ops[opnum].size;
+    size_t got = mm_malloc_batch(size, n, out);
+    size_t k;
+
+    for (k = 0; k < got; k++) {
+        trace->blocks[trace->ops[opnum + k].index] = out[k];
+        trace->block_sizes[trace->ops[opnum + k].index] = size;
+    }
+    return got == (size_t) n;
+}
+
+/*
+ * batch_free - Free the blocks of the n frees starting at opnum with a
+ *     single mm_free_batch call
+ */
+static void batch_free(trace_t *trace, int opnum, int n)
+{
+    void *ptrs[BATCH_MAX];
+    int k;
+
+    for (k = 0; k < n; k++)
+        ptrs[k] = trace->blocks[trace->ops[opnum + k].index];
+    mm_free_batch(ptrs, n);
+}
+
+/*
+ * pool_of - In pool mode, the pool serving mallocs of size bytes, made
+ *     on first use. NULL for sizes that go to mm_malloc.
+ */
+static mm_pool_t *pool_of(size_t size)
+{
+    mm_pool_t **pool;
+
+    if (!pool_mode || size == 0 || size > POOL_MAX)
+        return NULL;
+    pool = &pools[(size - 1) / POOL_STEP];
+    if (*pool == NULL
+        && (*pool = mm_pool_create((size + POOL_STEP - 1) & ~(POOL_STEP - 1), 0)) == NULL)
+        app_error("mm_pool_create failed for %zu bytes", size);
+    return *pool;
+}
+
+/*
+ * malloc_block - Allocate size bytes for block index of the trace, from
+ *     a pool in pool mode, passing on the lifetime hint if there is one
+ */
+static void *malloc_block(trace_t *trace, int index, size_t size, int hint)
+{
+    mm_pool_t *pool = pool_of(size);
+
+    trace->block_pools[index] = pool;
+    if (pool)
+        return mm_pool_alloc(pool);
+    return hint ? mm_malloc_hint(size, hint) : mm_malloc(size);
+}
+
+/*
+ * realloc_block - Resize block index of the trace to size bytes. A block
+ *     leaving or joining a pool is moved by hand.
+ */
+static void *realloc_block(trace_t *trace, int index, size_t size)
+{
+    char *oldp = trace->blocks[index];
+    size_t oldsize = trace->block_sizes[index];
+    mm_pool_t *oldpool = trace->block_pools[index];
+    mm_pool_t *pool = pool_of(size);
+    char *newp = NULL;
+
+    if (oldpool == NULL && pool == NULL)
+        return mm_realloc(oldp, size);
+    if (size > 0) {
+        if ((newp = pool ? mm_pool_alloc(pool) : mm_malloc(size)) == NULL)
+            return NULL;
+        if (oldp != NULL)
+            memcpy(newp, oldp, (size < oldsize) ? size : oldsize);
+    }
+    if (oldpool != NULL)
+        mm_pool_free(oldpool, oldp);
+    else
+        mm_free(oldp);
+    trace->block_pools[index] = pool;
+    return newp;
+}
+
+/*
+ * free_block - Free block index of the trace, through mm_free_sized with
+ *     its recorded size in sized mode and back to its pool in pool mode.
+ *     Index -1 is the null pointer.
+ */
+static void free_block(trace_t *trace, int index)
+{
+    if (index < 0)
+        mm_free(NULL);
+    else if (trace->block_pools[index] != NULL)
+        mm_pool_free(trace->block_pools[index], trace->blocks[index]);
+    else if (sized_mode)
+        mm_free_sized(trace->blocks[index], trace->block_sizes[index]);
+    else
+        mm_free(trace->blocks[index]);
+}
+
+/*
+ * reset_mm - Start the mm package over, on a fresh heap with mm_init,
+ *     or with mm_reset on the heap a previous run left behind
+ */
+static bool reset_mm(bool reset)
+{
+    /* Pools live in the heap and go with it */
+    memset(pools, 0, sizeof(pools));
+    if (reset)
+        return mm_reset();
+    mem_reset_brk();
+    return mm_init();
+}
+
+/*
+ * eval_mm_valid - Check the mm malloc package for correctness. With
+ *     reset, the heap of the previous run is discarded by mm_reset.
+ */
+static bool eval_mm_valid(trace_t *trace, range_set_t *ranges, bool reset)
+{
+    int i, k, n;
     int index;
-    size_t size;
+    size_t size, alignment;
     char *newp;
     char *oldp;
     char *p;
 
     /* Reset the heap and free any records in the range list */
-    mem_reset_brk();
     reinit_trace(trace);
 
     /* Call the mm package's init function */
-    if (!mm_init()) {
-        malloc_error(trace, 0, "mm_init failed.");
+    if (!reset_mm(reset)) {
+        malloc_error(trace, 0, reset ? "mm_reset failed." : "mm_init failed.");
         return false;
     }
 
@@ -1073,8 +1383,26 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
 
             case ALLOC: /* mm_malloc */
 
+                /* In batch mode a run of mallocs is one mm_malloc_batch */
+                if ((n = batch_len(trace, i)) > 1) {
+                    if (!batch_malloc(trace, i, n)) {
+                        malloc_error(trace, i, "mm_malloc_batch failed.");
+                        return false;
+                    }
+                    for (k = i; k < i + n; k++) {
+                        index = trace->ops[k].index;
+                        if (add_range(ranges, trace->blocks[index], size,
+                                      trace, k, index) == 0)
+                            return false;
+                        randomize_block(trace, index);
+                    }
+                    i += n - 1;
+                    break;
+                }
+
                 /* Call the student's malloc */
-                if ((p = mm_malloc(size)) == NULL) {
+                if ((p = malloc_block(trace, index, size,
+                                      trace->ops[i].hint)) == NULL) {
                     malloc_error(trace, i, "mm_malloc failed.");
                     return false;
                 }
@@ -1095,13 +1423,36 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                 randomize_block(trace, index);
                 break;
 
+            case MEMALIGN: /* mm_memalign */
+
+                /* Call the student's memalign */
+                alignment = trace->ops[i].alignment;
+                if ((p = mm_memalign(alignment, size)) == NULL) {
+                    malloc_error(trace, i, "mm_memalign failed.");
+                    return false;
+                }
+                if (((unsigned long)p) % alignment != 0) {
+                    malloc_error(trace, i,
+                                 "Payload address (%p) not aligned to %zu bytes",
+                                 p, alignment);
+                    return false;
+                }
+
+                /* Then check it like any other block */
+                if (add_range(ranges, p, size, trace, i, index) == 0)
+                    return false;
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                randomize_block(trace, index);
+                break;
+
             case REALLOC: /* mm_realloc */
                 if (!check_index(trace, i, index, 0))
                     return false;
 
                 /* Call the student's realloc */
                 oldp = trace->blocks[index];
-                newp = mm_realloc(oldp, size);
+                newp = realloc_block(trace, index, size);
                 if ( (newp == NULL) && (size != 0) ) {
                     malloc_error(trace, i, "mm_realloc failed.");
                     return false;
@@ -1139,17 +1490,26 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
                 break;
 
             case FREE: /* mm_free */
+
+                /* In batch mode a run of frees is one mm_free_batch */
+                if ((n = batch_len(trace, i)) > 1) {
+                    for (k = i; k < i + n; k++) {
+                        if (!check_index(trace, k, trace->ops[k].index, 0))
+                            return false;
+                        remove_range(ranges, trace->blocks[trace->ops[k].index]);
+                    }
+                    batch_free(trace, i, n);
+                    i += n - 1;
+                    break;
+                }
+
                 if (!check_index(trace, i, index, 0))
                     return false;
 
                 /* Remove region from list and call student's free function */
-                if (index == -1) {
-                    p = 0;
-                } else {
-                    p = trace->blocks[index];
-                    remove_range(ranges, p);
-                }
-                mm_free(p);
+                if (index != -1)
+                    remove_range(ranges, trace->blocks[index]);
+                free_block(trace, index);
                 break;
 
             default:
@@ -1165,16 +1525,15 @@ static bool eval_mm_valid(trace_t *trace, range_set_t *ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size of the heap in bytes while running the student's
+ *   malloc package on the trace. mem_sbrk() can shrink the heap, so
+ *   the peak and the final heap size are both recorded in stats.
  *
  *   A higher number is better: 1 is optimal.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
-    int i;
+    int i, k, n;
     int index;
     size_t size, newsize, oldsize;
     size_t max_total_size = 0;
@@ -1182,13 +1541,12 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     size_t max_heap_size = 0;
     size_t heap_size = 0;
     char *p;
-    char *newp, *oldp;
+    char *newp;
 
     reinit_trace(trace);
 
     /* initialize the heap and the mm malloc package */
-    mem_reset_brk();
-    if (!mm_init())
+    if (!reset_mm(false))
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -1198,7 +1556,17 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 index = trace->ops[i].index;
                 size = trace->ops[i].size;
 
-                if ((p = mm_malloc(size)) == NULL) {
+                if ((n = batch_len(trace, i)) > 1) {
+                    if (!batch_malloc(trace, i, n))
+                        app_error("trace %d: mm_malloc_batch failed in eval_mm_util",
+                                  tracenum);
+                    total_size += n * size;
+                    i += n - 1;
+                    break;
+                }
+
+                if ((p = malloc_block(trace, index, size,
+                                      trace->ops[i].hint)) == NULL) {
                     app_error("trace %d: mm_malloc failed in eval_mm_util",
                               tracenum);
                 }
@@ -1210,13 +1578,28 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 total_size += size;
                 break;
 
+            case MEMALIGN: /* mm_memalign */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+
+                if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL) {
+                    app_error("trace %d: mm_memalign failed in eval_mm_util",
+                              tracenum);
+                }
+
+                /* Remember region and size */
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+
+                total_size += size;
+                break;
+
             case REALLOC: /* mm_realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
                 oldsize = trace->block_sizes[index];
 
-                oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
+                if ((newp = realloc_block(trace, index, newsize)) == NULL && newsize != 0) {
                     app_error("trace %d: mm_realloc failed in eval_mm_util",
                               tracenum);
                 }
@@ -1229,16 +1612,18 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 break;
 
             case FREE: /* mm_free */
-                index = trace->ops[i].index;
-                if (index < 0) {
-                    size = 0;
-                    p = 0;
-                } else {
-                    size = trace->block_sizes[index];
-                    p = trace->blocks[index];
+                if ((n = batch_len(trace, i)) > 1) {
+                    for (k = i; k < i + n; k++)
+                        total_size -= trace->block_sizes[trace->ops[k].index];
+                    batch_free(trace, i, n);
+                    i += n - 1;
+                    break;
                 }
 
-                mm_free(p);
+                index = trace->ops[i].index;
+                size = (index < 0) ? 0 : trace->block_sizes[index];
+
+                free_block(trace, index);
 
                 total_size -= size;
                 break;
@@ -1260,6 +1645,9 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     printf(".");
 #endif
 
+    stats->peak_heap = max_heap_size;
+    stats->final_heap = heap_size;
+    stats->sbrk_calls = mem_sbrk_calls();
     return ((double)max_total_size / (double)max_heap_size);
 }
 
@@ -1270,46 +1658,62 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index;
+    int i, index, n;
     size_t size, newsize;
-    char *p, *newp, *oldp, *block;
+    char *p, *newp;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
 
-    /* Reset the heap and initialize the mm package */
-    mem_reset_brk();
-    if (!mm_init())
-        app_error("mm_init failed in eval_mm_speed");
+    /* Reset the heap and initialize the mm package, the utilization
+       run or a previous repetition left one for mm_reset to discard */
+    if (!reset_mm(reset_mode))
+        app_error("%s failed in eval_mm_speed", reset_mode ? "mm_reset" : "mm_init");
 
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
         switch (trace->ops[i].type) {
 
             case ALLOC: /* mm_malloc */
+                if ((n = batch_len(trace, i)) > 1) {
+                    if (!batch_malloc(trace, i, n))
+                        app_error("mm_malloc_batch error in eval_mm_speed");
+                    i += n - 1;
+                    break;
+                }
                 index = trace->ops[i].index;
                 size = trace->ops[i].size;
-                if ((p = mm_malloc(size)) == NULL)
+                if ((p = malloc_block(trace, index, size,
+                                      trace->ops[i].hint)) == NULL)
                     app_error("mm_malloc error in eval_mm_speed");
                 trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
+                break;
+
+            case MEMALIGN: /* mm_memalign */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+                if ((p = mm_memalign(trace->ops[i].alignment, size)) == NULL)
+                    app_error("mm_memalign error in eval_mm_speed");
+                trace->blocks[index] = p;
+                trace->block_sizes[index] = size;
                 break;
 
             case REALLOC: /* mm_realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
-                oldp = trace->blocks[index];
-                if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+                if ((newp = realloc_block(trace, index, newsize)) == NULL && newsize != 0)
                     app_error("mm_realloc error in eval_mm_speed");
                 trace->blocks[index] = newp;
+                trace->block_sizes[index] = newsize;
                 break;
 
             case FREE: /* mm_free */
-                index = trace->ops[i].index;
-                if (index < 0) {
-                    block = 0;
-                } else {
-                    block = trace->blocks[index];
+                if ((n = batch_len(trace, i)) > 1) {
+                    batch_free(trace, i, n);
+                    i += n - 1;
+                    break;
                 }
-                mm_free(block);
+                free_block(trace, trace->ops[i].index);
                 break;
 
             default:
@@ -1342,6 +1746,15 @@ static bool eval_libc_valid(trace_t *trace)
                 trace->blocks[trace->ops[i].index] = p;
                 break;
 
+            case MEMALIGN: /* posix_memalign */
+                if (posix_memalign((void **)&p, trace->ops[i].alignment,
+                                   trace->ops[i].size) != 0) {
+                    malloc_error(trace, i, "libc posix_memalign failed");
+                    unix_error("System message");
+                }
+                trace->blocks[trace->ops[i].index] = p;
+                break;
+
             case REALLOC: /* realloc */
                 newsize = trace->ops[i].size;
                 oldp = trace->blocks[trace->ops[i].index];
@@ -1393,6 +1806,15 @@ static void eval_libc_speed(void *ptr)
                 trace->blocks[index] = p;
                 break;
 
+            case MEMALIGN: /* posix_memalign */
+                index = trace->ops[i].index;
+                size = trace->ops[i].size;
+                if (posix_memalign((void **)&p, trace->ops[i].alignment,
+                                   size) != 0)
+                    unix_error("posix_memalign failed in eval_libc_speed");
+                trace->blocks[index] = p;
+                break;
+
             case REALLOC: /* realloc */
                 index = trace->ops[i].index;
                 newsize = trace->ops[i].size;
@@ -1792,12 +2214,100 @@ static double measure_ref_throughput() {
 }
 
 
+/*
+ * printheaps - prints the peak and final heap size the utilization run
+ *              of each trace left behind, and how many calls it made
+ *              to grow the heap
+ */
+static void printheaps(int n, stats_t *stats)
+{
+    int i;
+
+    if (tab_mode) {
+        printf("peak\tfinal\tsbrks\ttrace\n");
+    } else {
+        printf("  %12s %12s %6s %8s  %s\n", "peak", "final", "final%", "sbrks", "trace");
+    }
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        if (tab_mode) {
+            printf("%zu\t%zu\t%zu\t%s\n",
+                   stats[i].peak_heap, stats[i].final_heap,
+                   stats[i].sbrk_calls, stats[i].filename);
+        } else {
+            printf("  %12zu %12zu %5.1f%% %8zu  %s\n",
+                   stats[i].peak_heap, stats[i].final_heap,
+                   stats[i].peak_heap == 0 ? 0.0
+                   : 100.0 * stats[i].final_heap / stats[i].peak_heap,
+                   stats[i].sbrk_calls, stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printscans - reruns the traces with each fit scan after the first,
+ *              whose results are in stats, and prints the average
+ *              utilization and throughput of every one
+ */
+static void printscans(int n, const char *tracedir, char **tracefiles,
+                       stats_t *stats, speed_t *speed_params)
+{
+    stats_t *scan_stats;
+    double util[MAX_FIT_SCANS], kops[MAX_FIT_SCANS];
+    double secs, ops;
+    int util_weight, i, k;
+
+    scan_stats = (stats_t *)calloc(n, sizeof(stats_t));
+    if (scan_stats == NULL)
+        unix_error("scan_stats calloc in printscans failed");
+
+    for (k = 0; k < num_fit_scans; k++) {
+        if (k > 0) {
+            if (mm_fit_scan(0, fit_scans[k]) != 0)
+                app_error("mm_fit_scan rejected a scan of %u\n", fit_scans[k]);
+            memset(scan_stats, 0, n * sizeof(stats_t));
+            run_tests(n, tracedir, tracefiles, scan_stats, speed_params);
+            stats = scan_stats;
+        }
+        util[k] = secs = ops = 0;
+        util_weight = 0;
+        for (i = 0; i < n; i++) {
+            if (stats[i].weight == WALL || stats[i].weight == WPERF) {
+                secs += stats[i].secs;
+                ops += stats[i].ops;
+            }
+            if (stats[i].weight == WALL || stats[i].weight == WUTIL) {
+                util[k] += stats[i].util;
+                util_weight++;
+            }
+        }
+        util[k] = (util_weight == 0) ? 0 : util[k] / util_weight;
+        kops[k] = (secs == 0) ? 0 : ops / secs * 0.001;
+    }
+    free(scan_stats);
+    mm_fit_scan(0, fit_scans[0]);
+
+    if (tab_mode) {
+        printf("\nscan\tutil\tKops\n");
+    } else {
+        printf("\n  %6s %8s %10s\n", "scan", "util", "Kops");
+    }
+    for (k = 0; k < num_fit_scans; k++) {
+        if (tab_mode) {
+            printf("%u\t%.1f\t%.0f\n", fit_scans[k], util[k] * 100.0, kops[k]);
+        } else {
+            printf("  %6u %7.1f%% %10.0f\n", fit_scans[k], util[k] * 100.0, kops[k]);
+        }
+    }
+}
+
 /*
  * usage - Explain the command line arguments
  */
 static void usage(char *prog)
 {
-    fprintf(stderr, "Usage: %s [-hlVdD] [-f <file>]\n", prog);
+    fprintf(stderr, "Usage: %s [-hlVdDHBFRP] [-K <k,...>] [-L <n>] [-f <file>]\n", prog);
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
@@ -1809,5 +2319,20 @@ static void usage(char *prog)
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
     fprintf(stderr, "\t-T         Print diagnostics in tab mode\n");
+    fprintf(stderr, "\t-H         Print the peak and final heap size and the heap\n");
+    fprintf(stderr, "\t           growing calls of each trace\n");
+    fprintf(stderr, "\t-B         Replay runs of same-size mallocs and of frees through\n");
+    fprintf(stderr, "\t           mm_malloc_batch and mm_free_batch\n");
+    fprintf(stderr, "\t-F         Replay frees through mm_free_sized with the block's size\n");
+    fprintf(stderr, "\t-R         Start the second correctness run and the speed runs over\n");
+    fprintf(stderr, "\t           with mm_reset on the heap the previous run left\n");
+    fprintf(stderr, "\t-P         Replay requests of up to %d bytes through a pool per\n",
+            POOL_MAX);
+    fprintf(stderr, "\t           %d bytes of size, instead of mm_malloc; overrides -B\n",
+            POOL_STEP);
+    fprintf(stderr, "\t-K <k,...> Search each size class for the tightest of k blocks, 0 for\n");
+    fprintf(stderr, "\t           all; with several, the first is scored and all are compared\n");
+    fprintf(stderr, "\t-L <n>     Hint allocs freed within n requests short-lived and the\n");
+    fprintf(stderr, "\t           rest long-lived, in place of the trace's hints; 0 drops them\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file\n");
 }
@@ -4,6 +4,7 @@
  * package with the system's malloc package in libc.
  *
  */
+#define _GNU_SOURCE /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,34 +15,76 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/* The heap is split evenly between the regions */
+#define REGION_SIZE (MAX_HEAP_SIZE / MEM_REGIONS)
+
 /* private global variables */
 static unsigned char *heap;                 /* Starting address of heap */
-static unsigned char *mem_brk;              /* Current position of break */
-static unsigned char *mem_max_addr;         /* Maximum allowable heap address */
+static unsigned char *mem_brk[MEM_REGIONS]; /* Current position of each region's break */
+static size_t sbrk_calls;                   /* Calls that grew a region since the last reset */
+
+/* Mappings made by mm_map, kept for accounting and range checks */
+typedef struct {
+    unsigned char *addr;
+    size_t len;
+} mapping_t;
+
+static mapping_t *maps;                     /* Live mappings, in no order */
+static size_t num_maps;                     /* Entries in use in maps */
+static size_t max_maps;                     /* Entries allocated for maps */
+static size_t map_bytes;                    /* Total length of the live mappings */
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* 
  * mm_sbrk - simple model of the sbrk function. Extends the heap 
  *           by incr bytes and returns the start address of the
- *           new area. In this model, the heap cannot be shrunk.
+ *           new area, or shrinks it when incr is negative and returns
+ *           the old break. This is the break of region 0.
  */
 void *mm_sbrk(intptr_t incr) {
-    unsigned char *old_brk = mem_brk;
+    return mm_sbrk_region(0, incr);
+}
+
+/*
+ * mm_sbrk_region - mm_sbrk for the independent break of one region.
+ *           Regions never grow into each other. Whole pages given back
+ *           by a shrink are returned to the system and the rest of the
+ *           bytes cleared, so like fresh pages from sbrk the memory a
+ *           region grows into always reads as zero.
+ */
+void *mm_sbrk_region(int region, intptr_t incr) {
+    unsigned char *base = heap + (size_t) region * REGION_SIZE;
+    unsigned char *old_brk = mem_brk[region];
+    size_t pagesize = (size_t) getpagesize();
 
     bool ok = true;
-    if (incr < 0) {
+    if (incr < 0 && (size_t) -incr > (size_t)(old_brk - base)) {
 	ok = false;
-	fprintf(stderr, "ERROR: mm_sbrk failed.  Attempt to expand heap by negative value %ld\n", (long) incr);
-    } else if (mem_brk + incr > mem_max_addr) {
+	fprintf(stderr, "ERROR: mm_sbrk failed.  Attempt to shrink heap by %ld bytes, "
+		"below its start\n", (long) -incr);
+    } else if (incr < 0) {
+	unsigned char *lo = (unsigned char *)
+	    (((uintptr_t)(old_brk + incr) + pagesize - 1) & ~(uintptr_t)(pagesize - 1));
+	if (lo < old_brk)
+	    madvise(lo, (size_t)(old_brk - lo), MADV_DONTNEED);
+	else
+	    lo = old_brk;
+	memset(old_brk + incr, 0, (size_t)(lo - (old_brk + incr)));
+    } else if (old_brk + incr > base + REGION_SIZE) {
 	ok = false;
-	long alloc = mem_brk - heap + incr;
-	fprintf(stderr, "ERROR: mm_sbrk failed. Ran out of memory.  Would require heap size of %zd (0x%zx) bytes\n", alloc, alloc);
+	long alloc = old_brk - base + incr;
+	fprintf(stderr, "ERROR: mm_sbrk failed. Ran out of memory.  Would require "
+		"region %d size of %zd (0x%zx) bytes\n", region, alloc, alloc);
     }
     if (ok) {
-	mem_brk += incr;
+	if (incr > 0)
+	    __atomic_fetch_add(&sbrk_calls, 1, __ATOMIC_RELAXED);
+	mem_brk[region] += incr;
 	return (void *) old_brk;
     } else {
 	errno = ENOMEM;
@@ -57,17 +100,153 @@ void *mm_heap_lo(){
 }
 
 /* 
- * mm_heap_hi - return address of last heap byte
+ * mm_heap_hi - return address of last heap byte, the last byte
+ *           of the highest region in use
  */
 void *mm_heap_hi(){
-    return (void *)(mem_brk - 1);
+    int region;
+    for (region = MEM_REGIONS - 1; region > 0; region--) {
+	if (mem_brk[region] != heap + (size_t) region * REGION_SIZE)
+	    break;
+    }
+    return (void *)(mem_brk[region] - 1);
 }
 
 /*
- * mm_heapsize - returns the heap size in bytes
+ * mm_heapsize - returns the heap size in bytes, summed over the regions
+ *           and the live mappings
  */
 size_t mm_heapsize() {
-    return (size_t)(mem_brk - heap);
+    size_t size = map_bytes;
+    int region;
+    for (region = 0; region < MEM_REGIONS; region++)
+	size += (size_t)(mem_brk[region] - (heap + (size_t) region * REGION_SIZE));
+    return size;
+}
+
+/*
+ * mm_region_lo - return address of the first byte of a region
+ */
+void *mm_region_lo(int region){
+    return (void *)(heap + (size_t) region * REGION_SIZE);
+}
+
+/*
+ * mm_region_hi - return address of the last byte in use in a region
+ */
+void *mm_region_hi(int region){
+    return (void *)(mem_brk[region] - 1);
+}
+
+/*
+ * mm_region_of - returns the region holding addr, -1 outside the heap
+ */
+int mm_region_of(const void *addr){
+    const unsigned char *p = (const unsigned char *) addr;
+    if (p < heap || p >= heap + (size_t) MEM_REGIONS * REGION_SIZE)
+	return -1;
+    return (int)((size_t)(p - heap) / REGION_SIZE);
+}
+
+/*
+ * mm_map - maps len bytes, a multiple of the page size, of fresh memory
+ *           outside the heap regions. Returns NULL on failure.
+ */
+void *mm_map(size_t len) {
+    unsigned char *addr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED)
+	return NULL;
+
+    pthread_mutex_lock(&map_lock);
+    if (num_maps == max_maps) {
+	size_t max = max_maps ? 2 * max_maps : 64;
+	mapping_t *grown = realloc(maps, max * sizeof(mapping_t));
+	if (grown == NULL) {
+	    pthread_mutex_unlock(&map_lock);
+	    munmap(addr, len);
+	    return NULL;
+	}
+	maps = grown;
+	max_maps = max;
+    }
+    maps[num_maps].addr = addr;
+    maps[num_maps].len = len;
+    num_maps++;
+    map_bytes += len;
+    pthread_mutex_unlock(&map_lock);
+    return (void *) addr;
+}
+
+/*
+ * find_map - index of the mapping at addr of len bytes, or num_maps if
+ *           there is none. Called with map_lock held.
+ */
+static size_t find_map(void *addr, size_t len) {
+    size_t i;
+
+    for (i = 0; i < num_maps; i++) {
+	if (maps[i].addr == addr && maps[i].len == len)
+	    break;
+    }
+    return i;
+}
+
+/*
+ * mm_unmap - unmaps a mapping made by mm_map, given its address and
+ *           length. Returns 0 on success, -1 if there is no such mapping.
+ */
+int mm_unmap(void *addr, size_t len) {
+    size_t i;
+
+    pthread_mutex_lock(&map_lock);
+    if ((i = find_map(addr, len)) == num_maps) {
+	pthread_mutex_unlock(&map_lock);
+	fprintf(stderr, "ERROR: mm_unmap failed.  No mapping of %zu bytes at %p\n", len, addr);
+	errno = EINVAL;
+	return -1;
+    }
+    maps[i] = maps[--num_maps];
+    map_bytes -= len;
+    pthread_mutex_unlock(&map_lock);
+    munmap(addr, len);
+    return 0;
+}
+
+/*
+ * mm_remap - resizes a mapping made by mm_map to newlen bytes, a multiple
+ *           of the page size. The kernel moves the pages rather than their
+ *           contents, so the mapping may come back at a new address.
+ *           Returns NULL and leaves the mapping alone on failure.
+ */
+void *mm_remap(void *addr, size_t len, size_t newlen) {
+    unsigned char *newaddr;
+    size_t i;
+
+    pthread_mutex_lock(&map_lock);
+    if ((i = find_map(addr, len)) == num_maps) {
+	pthread_mutex_unlock(&map_lock);
+	fprintf(stderr, "ERROR: mm_remap failed.  No mapping of %zu bytes at %p\n", len, addr);
+	errno = EINVAL;
+	return NULL;
+    }
+    newaddr = mremap(addr, len, newlen, MREMAP_MAYMOVE);
+    if (newaddr == MAP_FAILED) {
+	pthread_mutex_unlock(&map_lock);
+	return NULL;
+    }
+    maps[i].addr = newaddr;
+    maps[i].len = newlen;
+    map_bytes = map_bytes - len + newlen;
+    pthread_mutex_unlock(&map_lock);
+    return (void *) newaddr;
+}
+
+/*
+ * mm_mapsize - returns the total length of the live mappings in bytes
+ */
+size_t mm_mapsize(void) {
+    return map_bytes;
 }
 
 /*
@@ -126,6 +305,7 @@ void *mm_memset(void *dst, int c, size_t n) {
  * mem_init - initialize the memory system model
  */
 void mem_init(){
+    int region;
     unsigned char* addr = mmap(NULL,                                        /* start*/
                                MAX_HEAP_SIZE,                               /* length */
                                PROT_READ | PROT_WRITE,                      /* permissions */
@@ -137,7 +317,8 @@ void mem_init(){
 	exit(1);
     }
     heap = addr;
-    mem_max_addr = addr + MAX_HEAP_SIZE;
+    for (region = 0; region < MEM_REGIONS; region++)
+	mem_brk[region] = heap + (size_t) region * REGION_SIZE;
     mem_reset_brk();
 }
 
@@ -145,6 +326,10 @@ void mem_init(){
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
+    mem_reset_brk();
+    free(maps);
+    maps = NULL;
+    max_maps = 0;
     if (munmap(heap, MAX_HEAP_SIZE) != 0) {
         fprintf(stderr, "FAILURE.  munmap couldn't deallocate heap space\n");
         exit(1);
@@ -152,10 +337,25 @@ void mem_deinit(void){
 }
 
 /*
- * mem_reset_brk - reset the simulated brk pointer to make an empty heap
+ * mem_reset_brk - reset the simulated brk pointers and drop every
+ *           mapping to make an empty heap. The pages in use are given
+ *           back, so the heap grows into zeroed memory again.
  */
 void mem_reset_brk(){
-    mem_brk = heap;
+    int region;
+    unsigned char *base;
+    for (region = 0; region < MEM_REGIONS; region++) {
+	base = heap + (size_t) region * REGION_SIZE;
+	if (mem_brk[region] > base)
+	    madvise(base, (size_t)(mem_brk[region] - base), MADV_DONTNEED);
+	mem_brk[region] = base;
+    }
+    sbrk_calls = 0;
+    while (num_maps > 0) {
+	num_maps--;
+	munmap(maps[num_maps].addr, maps[num_maps].len);
+    }
+    map_bytes = 0;
 }
 
 void *mem_sbrk(intptr_t incr) {
@@ -163,30 +363,57 @@ void *mem_sbrk(intptr_t incr) {
 }
 
 void *mem_heap_lo(){
-    return (void *) heap;
+    return mm_heap_lo();
 }
 
 void *mem_heap_hi(){
-    return (void *)(mem_brk - 1);
+    return mm_heap_hi();
 }
 
 size_t mem_heapsize() {
-    return (size_t)(mem_brk - heap);
+    return mm_heapsize();
+}
+
+/*
+ * mem_in_heap - returns whether the bytes lo..hi all lie within the
+ *           heap regions or within one mapping
+ */
+bool mem_in_heap(const void *lo, const void *hi) {
+    const unsigned char *l = lo;
+    const unsigned char *h = hi;
+    bool found = false;
+    size_t i;
+
+    if (l >= (unsigned char *) mem_heap_lo() && h <= (unsigned char *) mem_heap_hi())
+	return true;
+    pthread_mutex_lock(&map_lock);
+    for (i = 0; i < num_maps && !found; i++)
+	found = l >= maps[i].addr && h < maps[i].addr + maps[i].len;
+    pthread_mutex_unlock(&map_lock);
+    return found;
 }
 
 size_t mem_pagesize(){
     return (size_t) getpagesize();
 }
 
+/*
+ * mem_sbrk_calls - returns the number of calls that grew the heap since
+ *           the last mem_reset_brk
+ */
+size_t mem_sbrk_calls(void) {
+    return sbrk_calls;
+}
+
 /* Read len bytes and return value zero-extended to 64 bits */
 uint64_t mem_read(const void *addr, size_t len) {
-    uint64_t rdata;
-    /* Dense or non-heap read */
-    rdata = *(uint64_t *) addr;
-    if (len < sizeof(uint64_t)) {
-	uint64_t mask = ((uint64_t) 1 << (8 * len)) - 1;
-	rdata &= mask;
-    }
+    uint64_t rdata = 0;
+    /* Dense or non-heap read, never past addr + len: a payload may end
+       flush with the last page of a mapping */
+    if (len == sizeof(uint64_t))
+        rdata = *(uint64_t *) addr;
+    else
+        memcpy((void *) &rdata, addr, len);
     return rdata;
 }
 
@@ -2,9 +2,26 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/* The heap is made of MEM_REGIONS regions, each with its own break. Only
+   the thread safe build has arenas past the first, without it region 0
+   has the whole heap to itself */
+#ifdef THREADS
+#define MEM_REGIONS 8
+#else
+#define MEM_REGIONS 1
+#endif
+
 /* Support routines */
 
 void *mm_sbrk(intptr_t incr);
+void *mm_sbrk_region(int region, intptr_t incr);
+void *mm_region_lo(int region);
+void *mm_region_hi(int region);
+int mm_region_of(const void *addr);
+void *mm_map(size_t len);
+int mm_unmap(void *addr, size_t len);
+void *mm_remap(void *addr, size_t len, size_t newlen);
+size_t mm_mapsize(void);
 void *mm_heap_lo(void);
 void *mm_heap_hi(void);
 size_t mm_heapsize(void);
@@ -22,7 +39,9 @@ void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+bool mem_in_heap(const void *lo, const void *hi);
 size_t mem_pagesize(void);
+size_t mem_sbrk_calls(void);
 
 /* Read len bytes and return value zero-extended to 64 bits */
 /* Require 0 <= len <= 8 */
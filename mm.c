@@ -8,6 +8,7 @@
  *
  */
 #include <assert.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -35,6 +36,47 @@
 #define dbg_assert(...)
 #endif // DEBUG
 
+/*
+ * Small requests are served from runs of same-size slots by the slab
+ * engine. Comment out the following line to send every request through
+ * the segregated free lists.
+ */
+#define SLAB
+
+/*
+ * Uncomment the following line to index free blocks with Two-Level
+ * Segregated Fit lists instead of the power-of-two lists, which bounds
+ * the cost of every malloc and free.
+ */
+//#define TLSF
+
+/*
+ * Build with -DTHREADS to make the allocator thread safe. Threads
+ * are spread over MM_ARENAS arenas, each a heap of its own in a memlib
+ * region under its own lock, and each thread caches the small blocks it
+ * frees so most mallocs and frees never take a lock. memlib must see the
+ * flag too, it only splits the heap into regions then.
+ */
+//#define THREADS
+
+/*
+ * Uncomment the following line for compact block metadata: 4 byte headers
+ * and footers, and free list links stored as 32 bit offsets from the
+ * arena base. Payloads stay 16 byte aligned, a mini-block holds 12 bytes,
+ * and each arena is capped at 4GB so every size and offset fits.
+ */
+//#define COMPACT
+
+#ifdef THREADS
+#include <pthread.h>
+#define MM_ARENAS 8 //Arenas threads are spread over, at most MEM_REGIONS
+#else
+#define MM_ARENAS 1
+#endif
+#if MM_ARENAS > MEM_REGIONS
+#error "THREADS needs memlib built with it as well, set it in CFLAGS"
+#endif
+
 // do not change the following!
 #ifdef DRIVER
 // create aliases for driver tests
@@ -60,34 +102,178 @@ static size_t align(size_t x)
 /* 
  *Global Variables
  */
-static char *heap_listp; //Ptr to first block
 
 /*
  * Segregation free lists
+ * With TLSF the first level splits sizes by power of two and the second
+ * level splits each power of two into SL_COUNT equal ranges. The lists
+ * are stored flat, list (fl, sl) at (fl - FL_MIN) * SL_COUNT + sl.
+ * Without TLSF list i holds sizes [2^i, 2^(i+1)), except the last,
+ * TREE_LIST, which holds the root of a balanced tree of every block of
+ * 2^TREE_LIST bytes and up, so big blocks get best fit in O(log n).
  */
-#ifdef DEBUG
-#define totalTrace 15
+#define SL_LOG2 4 //log2 of the second level lists per first level
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_MIN 5 //32 byte blocks, the smallest kept outside mini_list
+#define FL_COUNT 36 //First levels up to 2^40 byte blocks, the heap maximum
+
+#ifdef TLSF
+#define totalTrace (FL_COUNT * SL_COUNT)
+#else
+#define TREE_LIST 12 //4096 byte blocks and up are kept in the tree
+#define totalTrace (TREE_LIST + 1)
+#define FIT_SCAN 8 //Blocks find_fit looks at in a list by default, 0 for all
+#define FIT_SCAN_MAX 255 //Largest scan mm_fit_scan accepts
+#endif
+
+/*
+ * Allocator state kept at the bottom of each arena's region, so the
+ * globals stay within the 128 byte budget. Bit i of classmap is set
+ * exactly when segfree_list[i] is non-empty, with TLSF fl_map and sl_map
+ * play that role one level each. Free 16 byte mini-blocks have no room
+ * for two links, they sit on the singly linked mini_list. With TLSF they
+ * sit on no list at all, unlinking one from mini_list takes a walk and
+ * would break the O(1) bound; they wait to coalesce with a neighbour.
+ */
+/*
+ * Slab engine: payloads of up to SLAB_MAX bytes live in runs, RUN_SIZE
+ * byte allocated blocks whose payloads are RUN_SIZE aligned, so back to
+ * back runs tile the heap. Runs are cut into equal slots with no per-slot
+ * header.
+ * A run starts with a run_t whose freemap has a bit set for every free
+ * slot. pagemap holds one bit per RUN_SIZE page of the heap, set for the
+ * pages that are runs, so free can tell slots from ordinary blocks.
+ * A run costs RUN_SIZE bytes however few of its slots are used, so a
+ * class only gets runs once it has asked for a run's worth of slots.
+ * Until then its requests take mini-blocks and ordinary blocks, and a
+ * trace with a handful of small objects does not pay a page for each.
+ */
+#define SLAB_MAX 32 //Largest payload served from a run
+#define SLAB_CLASSES (SLAB_MAX / 16) //One run class per 16 bytes of slot
+#define RUN_SIZE 4096 //Block size of a run, run payloads are aligned to this
+#define RUN_HDR 64 //Bytes in front of the first slot, sizeof(run_t) rounded up
+#define RUN_SLOTS (RUN_SIZE - WSIZE - RUN_HDR) //Slot bytes, the block header takes a word
+#define RUN_COUNT(cls) (RUN_SLOTS / (((size_t)(cls) + 1) * DSIZE)) //Slots in a run of class cls
+
+typedef struct run {
+    uint32_t slot; //slot size in bytes
+    uint32_t nfree; //free slots left
+    struct run *next; //runs of the same class with free slots
+    struct run *prev;
+    uint64_t freemap[4]; //bit set per free slot
+} run_t;
+
+/*
+ * Fastbins: exact size LIFO stacks of freed blocks of up to FAST_MAX bytes,
+ * linked through their first payload word. The blocks stay marked
+ * allocated, so nothing coalesces with them, and malloc of the same size
+ * takes them back without a split. consolidate frees them all for real
+ * when a fit search fails or before the heap is extended.
+ */
+#define FAST_MAX 512 //Largest block size kept in the fastbins
+#define FAST_BINS (FAST_MAX / 16) //One fastbin per 16 byte block size
+#define FAST_LIMIT (1<<16) //Most bytes the fastbins hold before they are consolidated
+
+typedef struct {
+#ifdef TLSF
+    uint64_t fl_map; //bit fl set when some list of first level fl is non-empty
+    uint16_t sl_map[FL_COUNT]; //bit sl set when list (fl, sl) is non-empty
+#else
+    uint64_t classmap;
+#endif
+    void *mini_list;
+    void *segfree_list[totalTrace];
+    void *fastbins[FAST_BINS]; //freed blocks of size (i + 1) * 16, still allocated
+    uint32_t fastmap; //bit i set exactly when fastbins[i] is non-empty
+    size_t fast_bytes; //bytes held in the fastbins
+    size_t grow_step; //fewest bytes the next heap extension asks for
+    size_t grow_clock; //allocations since the heap last grew
+    void *top; //free block ending the heap, kept out of the lists, or NULL
+    void *clean_top; //top when it is zero but for its first words and footer, or NULL
+    void *fresh; //block place last cut from clean_top
+#ifdef SLAB
+    run_t *slab_runs[SLAB_CLASSES]; //runs with free slots, per class
+    uint32_t slab_asked[SLAB_CLASSES]; //requests served from blocks before the class got runs
+    uint64_t *pagemap; //bit per heap page that is a run
+    size_t pagemap_bits; //pages covered by pagemap
+#endif
+    int region; //memlib region the arena grows in
+#ifdef THREADS
+    pthread_mutex_t lock; //guards the arena and everything above
+    uint32_t next_arena; //arena 0 only: round-robin counter for new threads
+    uint32_t arenas_ready; //arena 0 only: bit set per arena laid out
+#endif
+} heap_meta_t;
+#ifdef THREADS
+static __thread heap_meta_t *meta; //arena the thread holds the lock of
 #else
-#define totalTrace 16
+static heap_meta_t *meta;
+#endif
+#ifdef TREE_LIST
+//Blocks find_fit looks at in each list below the tree, it keeps the tightest
+//fit among them. Outlives mm_init so the driver can set it once for all traces
+static uint8_t fit_scan[TREE_LIST] = { [0 ... TREE_LIST - 1] = FIT_SCAN };
+#endif
+static void *map_list; //mapped blocks, they belong to no arena
+#ifdef THREADS
+static pthread_mutex_t map_mutex = PTHREAD_MUTEX_INITIALIZER; //guards map_list
 #endif
-void *segfree_list[totalTrace];
 
 /*
  * Functions Declare
  */
 static void *coalesce(void* ptr);
 static void *extend_heap(size_t words);
+static void *grow_heap(size_t asize);
 static void *find_fit(size_t asize);
 static void *place(void *ptr, size_t asize);
 static void insertNode(void *ptr, size_t asize);
 static void deleteNode(void *ptr);
+static int findList(size_t asize);
+static void markList(int listpos);
+static void unmarkList(int listpos);
+static void release_tail(void *ptr, size_t asize);
+static void *resize_in_place(void *ptr, size_t asize);
+static void *alloc_block(size_t asize);
+static void *alloc_aligned(size_t alignment, size_t asize);
+static void free_block(void *ptr, size_t size);
+static bool consolidate(void);
+static void trim_top(void *ptr);
+static void *map_alloc(size_t alignment, size_t size);
+#ifdef SLAB
+static bool in_slab(const void *ptr);
+#endif
+#ifdef TREE_LIST
+static void *tree_insert(void *root, void *node);
+static void *tree_remove(void *root, void *node);
+static void *tree_fit(void *root, size_t asize);
+#endif
 
 /*
  * Basic constants and static function for manipulating the free list.
  */
-#define WSIZE  8 //Word and header/footer size
-#define DSIZE  16 //Double word size
-#define CHUNKSIZE (1<<12) //Extend heap by this amount 4096
+#ifdef COMPACT
+#define WSIZE  4 //Word and header/footer size, also the size of a free list link
+#define COMPACT_MAX ((1ULL << 32) - DSIZE) //Most bytes an arena spans so 32 bits reach all of it
+typedef uint32_t word_t;
+#else
+#define WSIZE  8 //Word and header/footer size, also the size of a free list link
+typedef uint64_t word_t;
+#endif
+#define DSIZE  16 //Double word size, payloads and block sizes are multiples of it
+#define CHUNKSIZE (1<<12) //Initial heap extension 4096
+#define GROW_MIN 512 //Smallest step the heap grows by once it has gone quiet
+#define GROW_MAX (1<<15) //Largest step, half TRIM_THRESHOLD so unused growth is never trimmed alone
+#define GROW_RATIO 16 //A step is at most this fraction of the arena
+#define GROW_RECENT 64 //Allocations between two extensions that count as growing fast
+#define GROW_QUIET 1024 //Allocations without an extension that halve the step
+#define PREV_ALLOC 0x2 //Header bit set when the previous block is allocated
+#define PREV_MINI 0x4 //Header bit set when the previous block is a mini-block
+#define MINISIZE 16 //Mini-block size, a header and the rest of a double word of payload or link
+#define TRIM_THRESHOLD (1<<16) //A free top block this big is trimmed, 64KB
+#define TRIM_KEEP CHUNKSIZE //Bytes of the free top block kept by a trim
+#define MAPPED 0x8 //Header bit set on blocks with pages of their own
+#define MMAP_THRESHOLD (1<<18) //Requests this big get pages of their own, 256KB
 
 static size_t MAX(size_t x, size_t y){
     if(x > y){
@@ -96,6 +282,13 @@ static size_t MAX(size_t x, size_t y){
         return y;
     }
 }
+static size_t MIN(size_t x, size_t y){
+    if(x < y){
+        return x;
+    }else{
+        return y;
+    }
+}
 
 //Pack a size and allocated bit into a word
 static size_t PACK(size_t size, size_t alloc){
@@ -103,10 +296,10 @@ static size_t PACK(size_t size, size_t alloc){
 }
 //Read and write a word at address p
 static uint64_t GET(void* p){
-    return (*(uint64_t* )(p));
+    return (*(word_t* )(p));
 }
 static void PUT(void* p, size_t val){
-    (*(uint64_t* )(p) = (val));
+    (*(word_t* )(p) = (word_t)(val));
 }
 //Read the size and allocated fields from address p
 static uint64_t GET_SIZE(void* p){
@@ -115,19 +308,41 @@ static uint64_t GET_SIZE(void* p){
 static uint64_t GET_ALLOC(void* p){
     return (GET(p) & 0x1);
 }
+//Read and update the previous-block-allocated bit of the header at p
+static uint64_t GET_PREV_ALLOC(void* p){
+    return (GET(p) & PREV_ALLOC);
+}
+static void SET_PREV_ALLOC(void* p, size_t prev_alloc){
+    PUT(p, (GET(p) & ~(uint64_t)PREV_ALLOC) | prev_alloc);
+}
+//Read and update the previous-block-is-mini bit of the header at p
+static uint64_t GET_PREV_MINI(void* p){
+    return (GET(p) & PREV_MINI);
+}
+static void SET_PREV_MINI(void* p, size_t prev_mini){
+    PUT(p, (GET(p) & ~(uint64_t)PREV_MINI) | prev_mini);
+}
+//Both bits describing the previous block, kept when a header is rewritten
+static uint64_t GET_PREV_BITS(void* p){
+    return (GET(p) & (PREV_ALLOC | PREV_MINI));
+}
 //Given block ptr ptr, compute address of its header and footer
+//Only free blocks larger than a mini-block carry a footer
 static void* HDRP(void* ptr){
     return ((char *)(ptr) - WSIZE);
 }
 static char* FTRP(void* ptr){
-    return ((char *)(ptr) + GET_SIZE(HDRP(ptr)) - DSIZE);
+    return ((char *)(ptr) + GET_SIZE(HDRP(ptr)) - 2*WSIZE);
 }
 //Given block ptr ptr, compute address of next and previous blocks
 static void* NEXT_BLKP(void* ptr){
     return ((char *)(ptr) + GET_SIZE(((char *)(ptr) - WSIZE)));
 }
 static void* PREV_BLKP(void* ptr){
-    return ((char *)(ptr) - GET_SIZE(((char *)(ptr) - DSIZE)));
+    if(GET_PREV_MINI(HDRP(ptr))){
+        return ((char *)(ptr) - MINISIZE);
+    }
+    return ((char *)(ptr) - GET_SIZE(((char *)(ptr) - 2*WSIZE)));
 }
 //Given block ptr, compute the previous pointer and next pointer
 static void* PREV_PTR(void* ptr){
@@ -136,47 +351,135 @@ static void* PREV_PTR(void* ptr){
 static void* NEXT_PTR(void* ptr){
     return ((char *)(ptr) + WSIZE);
 }
+//Compact links are offsets from the arena base, which no block starts at, so 0 is NULL
 static void* PREV(void* ptr){
+#ifdef COMPACT
+    return GET(ptr) ? (char *)meta + GET(ptr) : NULL;
+#else
     return (*(char **)(ptr));
+#endif
 }
 static void* NEXT(void* ptr){
-    return (*(char **)(NEXT_PTR(ptr)));
+    return PREV(NEXT_PTR(ptr));
 }
 //Set Pointer
 static void SET(void* p, void* ptr){
+#ifdef COMPACT
+    PUT(p, ptr ? (char *)ptr - (char *)meta : 0);
+#else
     (*(uint64_t* )(p) = (uint64_t)(ptr));
+#endif
+}
+//Given a tree node, compute its children and subtree height
+//The links reuse the list link words, the height takes the next word
+static void* LEFT(void* ptr){
+    return PREV(ptr);
+}
+static void* RIGHT(void* ptr){
+    return NEXT(ptr);
+}
+static size_t HEIGHT(void* ptr){
+    return (ptr == NULL) ? 0 : GET((char *)(ptr) + 2*WSIZE);
+}
+//Write the header, and the footer unless it is a mini-block, of a free block
+static void PUT_FREE(void* ptr, size_t size, size_t prev_bits){
+    PUT(HDRP(ptr), PACK(size, prev_bits));
+    if(size > MINISIZE){
+        PUT(FTRP(ptr), PACK(size, 0));
+    }
+}
+
+/*
+ * Zero the word at p inside the free block ptr, unless it is one of the
+ * words the free lists keep at the front of the block
+ */
+static void clear_word(void *ptr, char *p){
+    if(p >= (char *)ptr + 3*WSIZE){
+        PUT(p, 0);
+    }
 }
 
 /*
- * Extends the heap with a new free block
+ * Extends the heap with a new free block, merged straight into the top
+ * block when there is one
  */
 static void *extend_heap(size_t words){
 
-    size_t *ptr;
+    char *ptr;
+    char *old;
     size_t size;
+    bool clean;
     
     //Allocate size to words size
     size = align(words);
-    if((long)(ptr = mem_sbrk(size)) == -1){
+#ifdef COMPACT
+    //Sizes and links are 32 bits, the arena may not outgrow them
+    if((size_t)((char *)mm_region_hi(meta->region) + 1 - (char *)meta) + size > COMPACT_MAX){
+        return(NULL);
+    }
+#endif
+    if((long)(ptr = mm_sbrk_region(meta->region, size)) == -1){
         return(NULL);
     }
+    //Memory from memlib is zero, the block stays clean unless it joins a dirty one
+    clean = GET_PREV_ALLOC(HDRP(ptr)) || meta->top == meta->clean_top;
+    //A free block before the old epilogue is the top block, grow it instead
+    old = ptr;
+    if(!GET_PREV_ALLOC(HDRP(ptr))){
+        ptr = meta->top;
+        size += GET_SIZE(HDRP(ptr));
+    }
     //Initialize free block header/footer and the epilogue header
-    PUT(HDRP(ptr), PACK(size, 0));  //Free block header
-    PUT(FTRP(ptr), PACK(size, 0));  //Free block footer
-    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 1));  //New epilogue header
-
-    //insertion of node into seg-free list
-    insertNode(ptr, size);
+    PUT_FREE(ptr, size, GET_PREV_BITS(HDRP(ptr)));
+    //New epilogue header, previous block free
+    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, (size == MINISIZE ? PREV_MINI : 0) | 1));
+    meta->top = ptr;
 
-    //Coalesce if the previous block was free
-    return coalesce(ptr);
+    if(!clean){
+        meta->clean_top = NULL;
+        return ptr;
+    }
+    meta->clean_top = ptr;
+    //The old footer and epilogue may now lie inside the block, clear them
+    if(old != ptr){
+        clear_word(ptr, old - 2*WSIZE);
+        clear_word(ptr, HDRP(old));
+    }
+    return ptr;
  }
+
+/*
+ * Grow heap function
+ * Returns a top block of at least asize bytes, growing the heap by only
+ * what the top block lacks, if it does at all. The heap
+ * grows by at least grow_step, which doubles while extensions follow
+ * within GROW_RECENT allocations of each other, up to GROW_MAX and an
+ * arena's GROW_RATIO-th, and halves for every GROW_QUIET allocations
+ * served without growing, down to GROW_MIN.
+ */
+static void *grow_heap(size_t asize){
+    size_t top = meta->top ? GET_SIZE(HDRP(meta->top)) : 0;
+    size_t heapsize = (char *)mm_region_hi(meta->region) + 1 - (char *)meta;
+    size_t quiet = meta->grow_clock / GROW_QUIET;
+    if(top >= asize){
+        return meta->top;
+    }
+    if(meta->grow_clock < GROW_RECENT){
+        meta->grow_step = MIN(2 * meta->grow_step,
+                              MAX(GROW_MIN, MIN(GROW_MAX, heapsize / GROW_RATIO)));
+    }else{
+        meta->grow_step = MAX(quiet < 32 ? meta->grow_step >> quiet : 0, GROW_MIN);
+    }
+    meta->grow_clock = 0;
+    return extend_heap(MAX(asize - top, meta->grow_step));
+}
  
  /*
   * coalesce pointer function
   */
 static void *coalesce(void* ptr){
-    size_t prev_alloc = GET_ALLOC(HDRP(PREV_BLKP(ptr)));
+    //The previous footer only exists when the previous block is free, so ask the header bit
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(ptr));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
     size_t size = GET_SIZE(HDRP(ptr));
 
@@ -189,28 +492,27 @@ static void *coalesce(void* ptr){
         deleteNode(ptr);
         deleteNode(NEXT_BLKP(ptr));
         size += GET_SIZE(HDRP(NEXT_BLKP(ptr))); //Increase size to next block header size
-        PUT(HDRP(ptr), PACK(size, 0)); //Free Header
-        PUT(FTRP(ptr), PACK(size, 0)); //Free Footer
     }
     //Case 3: Checks when prev block not allocated, but next block allocated
     else if(!prev_alloc && next_alloc){
         deleteNode(ptr);
         deleteNode(PREV_BLKP(ptr));
-        size += GET_SIZE(HDRP(PREV_BLKP(ptr))); //Increase size to previous block header size
-        PUT(FTRP(ptr), PACK(size, 0)); //Free Footer
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 0)); //Free previous header
         ptr = PREV_BLKP(ptr);
+        size += GET_SIZE(HDRP(ptr)); //Increase size to previous block header size
     }
     //Case 4: Checks when both prev and next block not allocated
     else{
         deleteNode(ptr);
         deleteNode(PREV_BLKP(ptr));
         deleteNode(NEXT_BLKP(ptr));
-        size += GET_SIZE(HDRP(PREV_BLKP(ptr))) + GET_SIZE(FTRP(NEXT_BLKP(ptr))); //Increase size to sum of previous block header size and next block footer size
-        PUT(HDRP(PREV_BLKP(ptr)), PACK(size, 0)); //Free previous block header
-        PUT(FTRP(NEXT_BLKP(ptr)), PACK(size, 0)); //Free next block footer
+        size += GET_SIZE(HDRP(NEXT_BLKP(ptr))); //Increase size by the next block header size
         ptr = PREV_BLKP(ptr); //Set block pointer to previous block pointer
+        size += GET_SIZE(HDRP(ptr)); //and by the previous block header size
     }
+    //Free header and footer, the merged block keeps what its first block knew about its predecessor
+    PUT_FREE(ptr, size, GET_PREV_BITS(HDRP(ptr)));
+    //The merged block is never a mini-block
+    SET_PREV_MINI(HDRP(NEXT_BLKP(ptr)), 0);
 
     //insert to empty list
     insertNode(ptr, size);
@@ -219,31 +521,84 @@ static void *coalesce(void* ptr){
 }
 /*
  * Find fit function
+ * Searches the lists, and takes from the top block only when they have
+ * nothing that fits
  */
+static void *top_fit(size_t asize){
+    return (meta->top != NULL && GET_SIZE(HDRP(meta->top)) >= asize) ? meta->top : NULL;
+}
 
+#ifdef TLSF
+static void *find_fit(size_t asize){
+    int fl, sl, listpos;
+    uint64_t flmap;
+    uint32_t slmap;
+    //Free mini-blocks are on no list, a 16 byte request takes the smallest listed block
+    if(asize < 2*DSIZE){
+        asize = 2*DSIZE;
+    }
+    //Round up to the next list, every block there and above fits
+    fl = 63 - __builtin_clzll(asize);
+    listpos = findList(asize + (1ULL << (fl - SL_LOG2)) - 1);
+    fl = listpos / SL_COUNT;
+    sl = listpos % SL_COUNT;
+    slmap = meta->sl_map[fl] & (~0U << sl);
+    if(slmap == 0){
+        //Nothing left in this first level, take the first non-empty one above
+        flmap = meta->fl_map & (~0ULL << (fl + 1));
+        if(flmap == 0){
+            return top_fit(asize);
+        }
+        fl = __builtin_ctzll(flmap);
+        slmap = meta->sl_map[fl];
+    }
+    return meta->segfree_list[fl * SL_COUNT + __builtin_ctz(slmap)];
+}
+#else
 static void *find_fit(size_t asize){
-    int listpos = 0;
-    size_t ssize = asize;
+    int listpos = findList(asize);
+    uint64_t higher;
     void *ptr;
-    while(listpos < totalTrace){
-        //find the list
-        if(((segfree_list[listpos] != NULL) && (ssize <= 1))){
-            ptr = segfree_list[listpos];
-            //find free block in the list
-            while((ptr != NULL) && ((asize > GET_SIZE(HDRP(ptr))))){
-                ptr = PREV(ptr);
-            }
-            //prevent uninitialized ptr, stop when the ptr has the value
-            if(ptr != NULL){
+    void *best;
+    size_t size, scan;
+    //mini-blocks are all the same size, any one fits
+    if(asize == MINISIZE && meta->mini_list != NULL){
+        return meta->mini_list;
+    }
+    if(listpos == TREE_LIST){
+        return (ptr = tree_fit(meta->segfree_list[TREE_LIST], asize)) ? ptr : top_fit(asize);
+    }
+    //the home list holds sizes in [2^listpos, 2^(listpos+1)) in no order,
+    //keep the tightest fit among the first fit_scan blocks, 0 scans them all
+    best = NULL;
+    scan = fit_scan[listpos] ? fit_scan[listpos] : SIZE_MAX;
+    for(ptr = meta->segfree_list[listpos]; ptr != NULL; ptr = PREV(ptr)){
+        size = GET_SIZE(HDRP(ptr));
+        if(size >= asize && (best == NULL || size < GET_SIZE(HDRP(best)))){
+            best = ptr;
+            if(size == asize){
                 break;
             }
         }
-        //shifts the search size to the right 1 and increment the position in the list by 1
-        ssize >>= 1;
-        listpos += 1;
+        if(--scan == 0){
+            break;
+        }
     }
-    return ptr;
+    if(best != NULL){
+        return best;
+    }
+    //every block in a higher non-empty list is big enough, take the head of the first one
+    higher = meta->classmap & ~((2ULL << listpos) - 1);
+    if(higher == 0){
+        return top_fit(asize);
+    }
+    listpos = __builtin_ctzll(higher);
+    if(listpos == TREE_LIST){
+        return (ptr = tree_fit(meta->segfree_list[TREE_LIST], asize)) ? ptr : top_fit(asize);
+    }
+    return meta->segfree_list[listpos];
 }
+#endif // TLSF
 
 /*
  * Place function
@@ -251,304 +606,2426 @@ static void *find_fit(size_t asize){
 static void *place(void *ptr, size_t asize){
     //retrieve the head size of the ptr
     size_t csize = GET_SIZE(HDRP(ptr));
-    //remove the ptr reference from the segfree_list
+    //A free block always follows an allocated one, so only its prev-mini bit varies
+    size_t prev_bits = GET_PREV_BITS(HDRP(ptr));
+    bool clean = (ptr == meta->clean_top);
+    if(clean){
+        meta->fresh = ptr;
+    }
+    //remove the ptr reference from the segfree_list, for the top block the
+    //remainder becomes the top again, so the split only moves the epilogue bits
     deleteNode(ptr);
-    //check if the overall size greater than 32 bytes
-    if((csize - asize) >= (2*DSIZE)){
-        PUT(HDRP(ptr), PACK(asize, 1));
-        PUT(FTRP(ptr), PACK(asize, 1));
+    //check if the remainder can hold at least a mini-block
+    if((csize - asize) >= MINISIZE){
+        PUT(HDRP(ptr), PACK(asize, prev_bits | 1));
         ptr = NEXT_BLKP(ptr);
-        PUT(HDRP(ptr), PACK(csize - asize, 0));
-        PUT(FTRP(ptr), PACK(csize - asize, 0));
+        PUT_FREE(ptr, csize - asize, PREV_ALLOC | (asize == MINISIZE ? PREV_MINI : 0));
+        SET_PREV_MINI(HDRP(NEXT_BLKP(ptr)), (csize - asize == MINISIZE) ? PREV_MINI : 0);
         //make insertion step into the segfree_list
         insertNode(ptr, csize - asize);
+        //The remainder of a clean block is clean past the links it now has
+        if(clean){
+            meta->clean_top = ptr;
+        }
     }else{
-        PUT(HDRP(ptr), PACK(csize, 1));
-        PUT(FTRP(ptr), PACK(csize, 1));
+        PUT(HDRP(ptr), PACK(csize, prev_bits | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)), PREV_ALLOC);
     }
     return(ptr);
 }
 
 /*
- * Insertion of node to seg-free list
+ * Place high function
+ * Like place, but cuts the allocated block from the high end of ptr and
+ * leaves the remainder free below it
  */
-static void insertNode(void *ptr, size_t asize){
-    //Declare list position, search thru list pointer, and insert thru list pointer
-    int listpos = 0;
-    void *sptr = NULL;
-    void *iptr = NULL;
-
-    //Find list position
-    while ((asize > 1) && (listpos < totalTrace - 1)){
-        //asize shift 1 to right and increase list position
-        asize >>= 1;
-        listpos += 1;
-
-    }
-
-    //Find position to insert
-    sptr = segfree_list[listpos];
-    while((sptr != NULL) && (asize > GET_SIZE(HDRP(sptr)))){
-        iptr = sptr;
-        sptr = PREV(sptr);
-    }
-    //Within search: 4 cases
-    if(sptr != NULL){
-        //insert in the front
-        if(iptr == NULL){
-            SET(PREV_PTR(ptr), sptr);
-            SET(NEXT_PTR(sptr), ptr);
-            SET(NEXT_PTR(ptr), NULL);
-            segfree_list[listpos] = ptr;
-        }else{
-            //insert in the middle
-            SET(PREV_PTR(ptr), sptr);
-            SET(NEXT_PTR(sptr), ptr);
-            SET(NEXT_PTR(ptr), iptr);
-            SET(PREV_PTR(iptr), ptr);
-        }   
-    }else{
-        //empty insert
-        if(iptr == NULL){
-            SET(PREV_PTR(ptr), NULL);
-            SET(NEXT_PTR(ptr), NULL);
-            segfree_list[listpos] = ptr;
-        }else{
-        //insert in the back
-        SET(PREV_PTR(ptr), NULL);
-        SET(NEXT_PTR(ptr), iptr);
-        SET(PREV_PTR(iptr), ptr);
-        }
+static void *place_high(void *ptr, size_t asize){
+    size_t csize = GET_SIZE(HDRP(ptr));
+    size_t rsize = csize - asize;
+    char *bp;
+    deleteNode(ptr);
+    if(rsize < MINISIZE){
+        PUT(HDRP(ptr), PACK(csize, GET_PREV_BITS(HDRP(ptr)) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)), PREV_ALLOC);
+        return ptr;
     }
+    //Write the header first, insertNode makes the remainder the top when no block follows it
+    bp = (char *)ptr + rsize;
+    PUT(HDRP(bp), PACK(asize, (rsize == MINISIZE ? PREV_MINI : 0) | 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)), PREV_ALLOC);
+    SET_PREV_MINI(HDRP(NEXT_BLKP(bp)), (asize == MINISIZE) ? PREV_MINI : 0);
+    PUT_FREE(ptr, rsize, GET_PREV_BITS(HDRP(ptr)));
+    insertNode(ptr, rsize);
+    return bp;
 }
 
 /*
- * Deletion of node to seg-free list
+ * Release tail function
+ * Shrinks the allocated block ptr to asize and frees the rest of it,
+ * when the rest can hold at least a mini-block
  */
-static void deleteNode(void *ptr){
-    int listpos = 0;
-    size_t asize = GET_SIZE(HDRP(ptr));
-
-    //Find list position
-    while ((asize > 1) && (listpos < totalTrace - 1)){
-        //asize shift 1 to right and increase list position
-        asize >>= 1;
-        listpos += 1;
+static void release_tail(void *ptr, size_t asize){
+    size_t csize = GET_SIZE(HDRP(ptr));
+    void *tail;
+    if((csize - asize) < MINISIZE){
+        return;
     }
+    PUT(HDRP(ptr), PACK(asize, GET_PREV_BITS(HDRP(ptr)) | 1));
+    //Turn the tail into an allocated block of its own, then free it so it coalesces forward
+    tail = NEXT_BLKP(ptr);
+    PUT(HDRP(tail), PACK(csize - asize, PREV_ALLOC | (asize == MINISIZE ? PREV_MINI : 0) | 1));
+    SET_PREV_MINI(HDRP(NEXT_BLKP(tail)), (csize - asize == MINISIZE) ? PREV_MINI : 0);
+    free_block(tail, csize - asize);
+}
 
-    //After found, 4 cases:
-    if(PREV(ptr) != NULL){
-        if(NEXT(ptr) == NULL){
-            //delete from the front
-            SET(NEXT_PTR(PREV(ptr)), NULL);
-            segfree_list[listpos] = PREV(ptr);
-        }else{
-            //delete from the middle
-            SET(NEXT_PTR(PREV(ptr)), NEXT(ptr));
-            SET(PREV_PTR(NEXT(ptr)), PREV(ptr));
-        }
-    }else{
-        if(NEXT(ptr) == NULL){
-            //delete on an empty free list
-            segfree_list[listpos] = NULL;
-        }else{
-            //delete from the back
-            SET(PREV_PTR(NEXT(ptr)), NULL);
+/*
+ * Resize in place function
+ * Tries to make the allocated block ptr asize bytes without moving its
+ * payload elsewhere: shrink by splitting, absorb a free successor,
+ * extend the heap by only the missing bytes when the block is last,
+ * or slide back into a free predecessor. Returns the (possibly moved)
+ * block, or NULL when none of these fit.
+ */
+static void *resize_in_place(void *ptr, size_t asize){
+    size_t csize = GET_SIZE(HDRP(ptr));
+    void *next = NEXT_BLKP(ptr);
+    size_t nsize = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    void *prev;
+    size_t total;
+    char *dst;
+    char *src;
+    size_t gap, len, n;
+
+    //Shrinking, or the slack already covers it
+    if(asize <= csize){
+        release_tail(ptr, asize);
+        return ptr;
+    }
+    //Last block (maybe followed by a free one), grow the heap by only the missing bytes
+    if(csize + nsize < asize && GET_SIZE(HDRP(NEXT_BLKP(nsize ? next : ptr))) == 0){
+        if(extend_heap(asize - csize - nsize) == NULL){
+            return NULL;
         }
+        nsize = asize - csize;
+    }
+    //Absorb the free successor
+    if(csize + nsize >= asize){
+        deleteNode(next);
+        total = csize + nsize;
+        PUT(HDRP(ptr), PACK(total, GET_PREV_BITS(HDRP(ptr)) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)), PREV_ALLOC);
+        SET_PREV_MINI(HDRP(NEXT_BLKP(ptr)), 0);
+        release_tail(ptr, asize);
+        return ptr;
+    }
+    //Slide back into the free predecessor, taking the successor too when free
+    if(GET_PREV_ALLOC(HDRP(ptr)) || GET_SIZE(HDRP(PREV_BLKP(ptr))) + csize + nsize < asize){
+        return NULL;
+    }
+    prev = PREV_BLKP(ptr);
+    total = GET_SIZE(HDRP(prev)) + csize + nsize;
+    deleteNode(prev);
+    if(nsize){
+        deleteNode(next);
+    }
+    //The regions overlap, copy forward in pieces no longer than the distance moved
+    dst = prev;
+    src = ptr;
+    gap = src - dst;
+    for(n = csize - WSIZE; n > 0; n -= len){
+        len = (n < gap) ? n : gap;
+        memcpy(dst, src, len);
+        dst += len;
+        src += len;
     }
+    PUT(HDRP(prev), PACK(total, GET_PREV_BITS(HDRP(prev)) | 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(prev)), PREV_ALLOC);
+    SET_PREV_MINI(HDRP(NEXT_BLKP(prev)), 0);
+    release_tail(prev, asize);
+    return prev;
 }
 
+#ifdef TLSF
 /*
- * mm_init: returns false on error, true on success.
+ * List position of a block size: the first level is floor(log2(asize))
+ * from a count of leading zeros, the second level the next SL_LOG2 bits
  */
-bool mm_init(void)
-{
-    // IMPLEMENT THIS
-    mm_checkheap(__LINE__);
-    //Initialize segfree list
-    for(int listpos = 0; listpos < totalTrace; listpos++){
-        segfree_list[listpos] = NULL;
-    }
-    //Create the initial empty heap
-    if ((heap_listp = mem_sbrk(4*WSIZE)) == NULL){
-        return false;
+static int findList(size_t asize){
+    int fl = 63 - __builtin_clzll(asize);
+    int sl = (asize >> (fl - SL_LOG2)) & (SL_COUNT - 1);
+    if(fl > FL_MIN + FL_COUNT - 1){
+        fl = FL_MIN + FL_COUNT - 1;
+        sl = SL_COUNT - 1;
     }
-    PUT(heap_listp, 0); //Alignment padding
-    PUT(heap_listp + (1*WSIZE), PACK(DSIZE, 1)); //Prologue header
-    PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); //Prologue footer
-    PUT(heap_listp + (3*WSIZE), PACK(0, 1)); //Epilogue header
-    heap_listp += (2*WSIZE);
+    return (fl - FL_MIN) * SL_COUNT + sl;
+}
 
-    //Extend the empty heap with a free block of CHUNKSIZE bytes
-    if(extend_heap(CHUNKSIZE) == NULL){
-        return false;
-    }
-    return true;
+/*
+ * Mark list listpos non-empty in both levels of bitmap
+ */
+static void markList(int listpos){
+    meta->sl_map[listpos / SL_COUNT] |= (1U << (listpos % SL_COUNT));
+    meta->fl_map |= (1ULL << (listpos / SL_COUNT));
 }
 
 /*
- * malloc
+ * Mark list listpos empty, and its first level too once all its lists are
  */
-void* malloc(size_t size)
-{
-    // IMPLEMENT THIS
-    mm_checkheap(__LINE__);
-    // Find space, free size of heap, multiple heap block, allocate, find free block, use, else create new block
-    size_t asize; // Adjusted block size
-    size_t extendsize; //Amount to extend heap if no fit
-    char *ptr;
-    //Ignore requests if empty
-    if(size == 0){
-        return NULL;
-    }
-    //Adjust block size to include overhead and alignment requests
-    if(size <= DSIZE){
-        asize = 2*DSIZE;
-    }else{
-        //align the allocated size to 16 bytes
-        asize = align(size + DSIZE);
+static void unmarkList(int listpos){
+    meta->sl_map[listpos / SL_COUNT] &= ~(1U << (listpos % SL_COUNT));
+    if(meta->sl_map[listpos / SL_COUNT] == 0){
+        meta->fl_map &= ~(1ULL << (listpos / SL_COUNT));
     }
-    //Search the free list for a fit
-    if((ptr = find_fit(asize)) != NULL){
-        place(ptr, asize);
-        return ptr;
+}
+#else
+/*
+ * List position of a block size: floor(log2(asize)) from a count of
+ * leading zeros, capped at the tree
+ */
+static int findList(size_t asize){
+    int listpos = 63 - __builtin_clzll(asize);
+    if(listpos > totalTrace - 1){
+        listpos = totalTrace - 1;
     }
+    return listpos;
+}
 
-    //No fit found, Get more memory and place the block
-    extendsize = MAX(asize, CHUNKSIZE);
-    //Extend_heap by extendsize
-    if((ptr = extend_heap(extendsize)) == NULL){
-        return NULL;
-    }
-    place(ptr, asize);
-    return ptr;
+/*
+ * Mark list listpos non-empty in the classmap
+ */
+static void markList(int listpos){
+    meta->classmap |= (1ULL << listpos);
 }
 
 /*
- * free
+ * Mark list listpos empty in the classmap
  */
-void free(void* ptr)
-{
-    // IMPLEMENT THIS
-    mm_checkheap(__LINE__);
-    if(ptr == NULL){
-        return;
-    }
-    //free block, write implementation add back to free list.
-    //Change allocation....etc
-    size_t size = GET_SIZE(HDRP(ptr));
-    PUT(HDRP(ptr), PACK(size, 0));
-    PUT(FTRP(ptr), PACK(size, 0));
-    //Insert the into the segfree_list based off the ptr and size
-    insertNode(ptr, size);
-    coalesce(ptr);
-    
+static void unmarkList(int listpos){
+    meta->classmap &= ~(1ULL << listpos);
 }
+#endif // TLSF
 
+#ifdef TREE_LIST
 /*
- * realloc
+ * Size ordered tree of the big free blocks
+ * An AVL tree keyed by (size, address), so keys are unique and the best
+ * fit is the leftmost block big enough. Nodes live in the free blocks
+ * themselves: left and right child over the list links and the subtree
+ * height in the third word, which blocks of 2^TREE_LIST bytes have room for.
  */
-void* realloc(void* oldptr, size_t size)
-{
-    // IMPLEMENT THIS
-    mm_checkheap(__LINE__);
-    size_t oldsize;
-    void* newptr;
-    // Check if oldptr is empty, then if it does, we just recurrsively calls malloc function
-    if(oldptr == NULL){
-        return malloc(size);
-    }
-    //Check if size has any value, if it doesn't then it would just deallocates the oldptr passed into the realloc function
-    if(size == 0){
-        free(oldptr);
-        return NULL;
+static bool tree_less(void *a, void *b){
+    size_t asize = GET_SIZE(HDRP(a));
+    size_t bsize = GET_SIZE(HDRP(b));
+    return asize < bsize || (asize == bsize && (char *)a < (char *)b);
+}
+
+/*
+ * Store node's children, recompute its height and restore the AVL
+ * balance with one or two rotations. Returns the new subtree root.
+ */
+static void *tree_balance(void *node, void *left, void *right){
+    void *pivot;
+    size_t hl = HEIGHT(left);
+    size_t hr = HEIGHT(right);
+
+    if(hl > hr + 1){
+        //Left heavy, a left-right case first rotates the left child
+        if(HEIGHT(RIGHT(left)) > HEIGHT(LEFT(left))){
+            pivot = RIGHT(left);
+            left = tree_balance(pivot, tree_balance(left, LEFT(left), LEFT(pivot)), RIGHT(pivot));
+        }
+        return tree_balance(left, LEFT(left), tree_balance(node, RIGHT(left), right));
     }
-    newptr = malloc(size);
-    //Create a size of the input size and copy over
-    if(newptr == NULL){
-        return NULL;
-    }else{
-        //Get oldptr size, copy over oldptr size to newly created size ptr, deallocates the oldptr
-        oldsize = GET_SIZE(HDRP(oldptr));
-        if(oldsize > size){
-            oldsize = size;
+    if(hr > hl + 1){
+        //Right heavy, mirror image
+        if(HEIGHT(LEFT(right)) > HEIGHT(RIGHT(right))){
+            pivot = LEFT(right);
+            right = tree_balance(pivot, LEFT(pivot),
+                                 tree_balance(right, RIGHT(pivot), RIGHT(right)));
         }
-        memcpy(newptr, oldptr, oldsize);
-        free(oldptr);
+        return tree_balance(right, tree_balance(node, left, LEFT(right)), RIGHT(right));
     }
-    return (newptr);
+    SET(PREV_PTR(node), left);
+    SET(NEXT_PTR(node), right);
+    PUT((char *)node + 2*WSIZE, MAX(hl, hr) + 1);
+    return node;
 }
 
 /*
- * calloc
- * This function is not tested by mdriver, and has been implemented for you.
+ * Insert node below root, returns the new root
  */
-void* calloc(size_t nmemb, size_t size)
-{
-    void* ptr;
-    size *= nmemb;
-    ptr = malloc(size);
-    if (ptr) {
-        memset(ptr, 0, size);
+static void *tree_insert(void *root, void *node){
+    if(root == NULL){
+        return tree_balance(node, NULL, NULL);
     }
-    return ptr;
+    if(tree_less(node, root)){
+        return tree_balance(root, tree_insert(LEFT(root), node), RIGHT(root));
+    }
+    return tree_balance(root, LEFT(root), tree_insert(RIGHT(root), node));
 }
 
 /*
- * Returns whether the pointer is in the heap.
- * May be useful for debugging.
+ * Unlink the leftmost node below root, returned in *min, returns the new root
  */
-static bool in_heap(const void* p)
-{
-    return p <= mm_heap_hi() && p >= mm_heap_lo();
+static void *tree_remove_min(void *root, void **min){
+    if(LEFT(root) == NULL){
+        *min = root;
+        return RIGHT(root);
+    }
+    return tree_balance(root, tree_remove_min(LEFT(root), min), RIGHT(root));
 }
 
 /*
- * Returns whether the pointer is aligned.
- * May be useful for debugging.
+ * Remove node from below root, returns the new root
  */
-static bool aligned(const void* p)
-{
-    size_t ip = (size_t) p;
-    return align(ip) == ip;
+static void *tree_remove(void *root, void *node){
+    void *succ;
+    void *right;
+
+    if(root != node){
+        if(tree_less(node, root)){
+            return tree_balance(root, tree_remove(LEFT(root), node), RIGHT(root));
+        }
+        return tree_balance(root, LEFT(root), tree_remove(RIGHT(root), node));
+    }
+    //Found it, a node with two children is replaced by its successor
+    if(LEFT(node) == NULL){
+        return RIGHT(node);
+    }
+    if(RIGHT(node) == NULL){
+        return LEFT(node);
+    }
+    right = tree_remove_min(RIGHT(node), &succ);
+    return tree_balance(succ, LEFT(node), right);
 }
 
 /*
- * mm_checkheap
+ * Best fit: the smallest, then lowest, block of at least asize bytes
  */
-bool mm_checkheap(int lineno)
+static void *tree_fit(void *root, size_t asize){
+    void *best = NULL;
+
+    while(root != NULL){
+        if(GET_SIZE(HDRP(root)) >= asize){
+            best = root;
+            root = LEFT(root);
+        }else{
+            root = RIGHT(root);
+        }
+    }
+    return best;
+}
+#endif // TREE_LIST
+
+/*
+ * Insertion of node to seg-free list
+ */
+static void insertNode(void *ptr, size_t asize){
+    int listpos;
+    void *head;
+
+    //The free block ending the heap is the top block, kept out of the lists
+    if(GET_SIZE(HDRP(NEXT_BLKP(ptr))) == 0){
+        meta->top = ptr;
+        return;
+    }
+
+    //mini-blocks are pushed on the singly linked mini_list, with TLSF on no list
+    if(asize == MINISIZE){
+#ifndef TLSF
+        SET(PREV_PTR(ptr), meta->mini_list);
+        meta->mini_list = ptr;
+#endif
+        return;
+    }
+
+    listpos = findList(asize);
+#ifdef TREE_LIST
+    if(listpos == TREE_LIST){
+        meta->segfree_list[TREE_LIST] = tree_insert(meta->segfree_list[TREE_LIST], ptr);
+        markList(TREE_LIST);
+        return;
+    }
+#endif
+    //insert in the front, the node becomes the new list head
+    head = meta->segfree_list[listpos];
+    SET(PREV_PTR(ptr), head);
+    SET(NEXT_PTR(ptr), NULL);
+    if(head != NULL){
+        SET(NEXT_PTR(head), ptr);
+    }
+    meta->segfree_list[listpos] = ptr;
+    //Mark the list non-empty
+    markList(listpos);
+}
+
+/*
+ * Deletion of node to seg-free list
+ */
+static void deleteNode(void *ptr){
+    int listpos;
+#ifndef TLSF
+    void *sptr;
+#endif
+
+    //Whatever happens to the block next may dirty it
+    if(ptr == meta->clean_top){
+        meta->clean_top = NULL;
+    }
+    if(ptr == meta->top){
+        meta->top = NULL;
+        return;
+    }
+
+    //mini-blocks have no back link, walk the mini_list to the predecessor
+    if(GET_SIZE(HDRP(ptr)) == MINISIZE){
+#ifndef TLSF
+        if(meta->mini_list == ptr){
+            meta->mini_list = PREV(ptr);
+            return;
+        }
+        for(sptr = meta->mini_list; PREV(sptr) != ptr; sptr = PREV(sptr)){
+        }
+        SET(PREV_PTR(sptr), PREV(ptr));
+#endif
+        return;
+    }
+    listpos = findList(GET_SIZE(HDRP(ptr)));
+#ifdef TREE_LIST
+    if(listpos == TREE_LIST){
+        meta->segfree_list[TREE_LIST] = tree_remove(meta->segfree_list[TREE_LIST], ptr);
+        if(meta->segfree_list[TREE_LIST] == NULL){
+            unmarkList(TREE_LIST);
+        }
+        return;
+    }
+#endif
+
+    //After found, 4 cases:
+    if(PREV(ptr) != NULL){
+        if(NEXT(ptr) == NULL){
+            //delete from the front
+            SET(NEXT_PTR(PREV(ptr)), NULL);
+            meta->segfree_list[listpos] = PREV(ptr);
+        }else{
+            //delete from the middle
+            SET(NEXT_PTR(PREV(ptr)), NEXT(ptr));
+            SET(PREV_PTR(NEXT(ptr)), PREV(ptr));
+        }
+    }else{
+        if(NEXT(ptr) == NULL){
+            //delete on an empty free list
+            meta->segfree_list[listpos] = NULL;
+            unmarkList(listpos);
+        }else{
+            //delete from the back
+            SET(PREV_PTR(NEXT(ptr)), NULL);
+        }
+    }
+}
+
+/*
+ * Fast pop function
+ * Takes a block of exactly asize bytes off its fastbin, NULL when the
+ * size has no fastbin or it is empty
+ */
+static void *fast_pop(size_t asize){
+    int bin = asize / DSIZE - 1;
+    void *ptr;
+    if(asize > FAST_MAX || (ptr = meta->fastbins[bin]) == NULL){
+        return NULL;
+    }
+    if((meta->fastbins[bin] = PREV(ptr)) == NULL){
+        meta->fastmap &= ~(1U << bin);
+    }
+    return ptr;
+}
+
+/*
+ * Allocate block function
+ * The general path: place an asize byte block from the free lists,
+ * extending the heap when nothing fits
+ */
+static void *alloc_block(size_t asize){
+    char *ptr;
+    meta->grow_clock++;
+    //A fastbin block of the exact size is ready as it is
+    if((ptr = fast_pop(asize)) != NULL){
+        return ptr;
+    }
+    //Search the free list for a fit, merging the fastbins in before giving up
+    if((ptr = find_fit(asize)) != NULL || (consolidate() && (ptr = find_fit(asize)) != NULL)){
+        place(ptr, asize);
+        return ptr;
+    }
+
+    //No fit found, Get more memory and place the block
+    if((ptr = grow_heap(asize)) == NULL){
+        return NULL;
+    }
+    place(ptr, asize);
+    return ptr;
+}
+
+/*
+ * Allocate short-lived block function
+ * Takes an exact fastbin block, or else cuts an asize byte block from the
+ * high end of the top block, or of a fit when the top is too small, so
+ * temporaries gather above the blocks that outlive them and merge back
+ * into one free block as they go
+ */
+static void *alloc_short(size_t asize){
+    char *ptr;
+    meta->grow_clock++;
+    if((ptr = fast_pop(asize)) != NULL){
+        return ptr;
+    }
+    if((ptr = top_fit(asize)) == NULL && (ptr = find_fit(asize)) == NULL
+       && (!consolidate() || (ptr = find_fit(asize)) == NULL)
+       && (ptr = grow_heap(asize)) == NULL){
+        return NULL;
+    }
+    return place_high(ptr, asize);
+}
+
+/*
+ * Allocate aligned function
+ * Allocates an asize byte block whose payload is a multiple of alignment
+ * (a power of two above ALIGNMENT). The leading gap is split off and freed
+ * rather than left as padding, the tail goes back through release_tail.
+ */
+static void *alloc_aligned(size_t alignment, size_t asize){
+    char *ptr;
+    char *aptr;
+    char *brk;
+    size_t csize, gap;
+    //Payloads are 16 byte aligned, so the gap is 0 or at least a mini-block
+    if((ptr = find_fit(asize + alignment - DSIZE)) == NULL
+       && (!consolidate() || (ptr = find_fit(asize + alignment - DSIZE)) == NULL)){
+        //Grow the heap far enough for an aligned block starting in the top block
+        brk = (char *)mm_region_hi(meta->region) + 1;
+        ptr = meta->top ? (char *)meta->top : brk;
+        aptr = (char *)(((uintptr_t)ptr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        if(aptr + asize > brk && grow_heap(aptr + asize - ptr) == NULL){
+            return NULL;
+        }
+    }
+    place(ptr, GET_SIZE(HDRP(ptr)));
+    aptr = (char *)(((uintptr_t)ptr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    if(aptr != ptr){
+        gap = aptr - ptr;
+        csize = GET_SIZE(HDRP(ptr));
+        PUT(HDRP(aptr), PACK(csize - gap, PREV_ALLOC | (gap == MINISIZE ? PREV_MINI : 0) | 1));
+        SET_PREV_MINI(HDRP(NEXT_BLKP(aptr)), (csize - gap == MINISIZE) ? PREV_MINI : 0);
+        PUT(HDRP(ptr), PACK(gap, GET_PREV_BITS(HDRP(ptr)) | 1));
+        //free the gap so it coalesces with whatever precedes it
+        free_block(ptr, gap);
+    }
+    release_tail(aptr, asize);
+    return aptr;
+}
+
+/*
+ * Arena owning ptr, the one whose memlib region it lies in, NULL for mapped blocks
+ */
+static heap_meta_t *arena_of(const void *ptr){
+#ifdef THREADS
+    int region = mm_region_of(ptr);
+    //Mapped blocks lie outside every region and belong to no arena
+    return (region < 0) ? NULL : mm_region_lo(region);
+#else
+    return meta;
+#endif
+}
+
+/*
+ * Free block function
+ * Returns the allocated ordinary block ptr of size bytes to the free lists,
+ * the size picks its list and places its footer without reading the header
+ */
+static void free_block(void *ptr, size_t size){
+    dbg_assert(GET_SIZE(HDRP(ptr)) == size);
+    PUT_FREE(ptr, size, GET_PREV_BITS(HDRP(ptr)));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)), 0);
+    //Insert the into the segfree_list based off the ptr and size
+    insertNode(ptr, size);
+    ptr = coalesce(ptr);
+    //A block this big going free is the time to give memory back, so the
+    //fastbins are merged first and whatever free block ends the heap trimmed
+    if(GET_SIZE(HDRP(ptr)) >= TRIM_THRESHOLD && consolidate()){
+        if(meta->top != NULL){
+            trim_top(meta->top);
+        }
+        return;
+    }
+    trim_top(ptr);
+}
+
+/*
+ * Fast free function
+ * Pushes a small allocated block of size bytes on its fastbin, leaving it allocated
+ */
+static void fast_free(void *ptr, size_t size){
+    int bin = size / DSIZE - 1;
+    SET(PREV_PTR(ptr), meta->fastbins[bin]);
+    meta->fastbins[bin] = ptr;
+    meta->fastmap |= 1U << bin;
+    //Bound what the fastbins keep from the free lists
+    if((meta->fast_bytes += size) > FAST_LIMIT){
+        consolidate();
+    }
+}
+
+/*
+ * Returns whether ptr, a block of size bytes, is the last block of the
+ * heap, or the last but a free one
+ */
+static bool ends_heap(void *ptr, size_t size){
+    void *next = (char *)ptr + size;
+    if(!GET_ALLOC(HDRP(next))){
+        next = NEXT_BLKP(next);
+    }
+    return GET_SIZE(HDRP(next)) == 0;
+}
+
+/*
+ * Consolidate function
+ * Frees every fastbin block for real, coalescing each with its free
+ * neighbours. Returns whether there was anything to free.
+ */
+static bool consolidate(void){
+    uint32_t map = meta->fastmap;
+    void *ptr;
+    void *next;
+    int bin;
+    if(map == 0){
+        return false;
+    }
+    meta->fastmap = 0;
+    meta->fast_bytes = 0;
+    while(map != 0){
+        bin = __builtin_ctz(map);
+        map &= map - 1;
+        ptr = meta->fastbins[bin];
+        meta->fastbins[bin] = NULL;
+        for(; ptr != NULL; ptr = next){
+            next = PREV(ptr);
+            free_block(ptr, (bin + 1) * DSIZE);
+        }
+    }
+    return true;
+}
+
+/*
+ * Trim top function
+ * Gives the break back when the free block ptr is the last in the heap
+ * and at least TRIM_THRESHOLD bytes, keeping TRIM_KEEP of it
+ */
+static void trim_top(void *ptr){
+    size_t size = GET_SIZE(HDRP(ptr));
+    if(size < TRIM_THRESHOLD || GET_SIZE(HDRP(NEXT_BLKP(ptr))) != 0){
+        return;
+    }
+    deleteNode(ptr);
+    if((long)mm_sbrk_region(meta->region, -(intptr_t)(size - TRIM_KEEP)) == -1){
+        insertNode(ptr, size);
+        return;
+    }
+    PUT_FREE(ptr, TRIM_KEEP, GET_PREV_BITS(HDRP(ptr)));
+    PUT(HDRP(NEXT_BLKP(ptr)), PACK(0, 1)); //New epilogue header, previous block free
+    insertNode(ptr, TRIM_KEEP);
+}
+
+/*
+ * Length of the mapping that holds a size byte payload and its header,
+ * 0 when that overflows
+ */
+static size_t map_len(size_t size){
+    size_t pagesize = mm_pagesize();
+    size_t len = (size + DSIZE + pagesize - 1) & ~(pagesize - 1);
+    return (len < size) ? 0 : len;
+}
+
+/*
+ * Length of the mapping holding the mapped block ptr, kept in the double
+ * word behind the payload since it may not fit a header
+ */
+static size_t map_size(void *ptr){
+    return *(size_t *)((char *)ptr - DSIZE);
+}
+
+/*
+ * Start of the mapping holding the mapped block ptr. The header's size
+ * is the gap in front of the mapping length: the map_list links, then
+ * whatever an aligned payload was pushed up by.
+ */
+static char *map_base(void *ptr){
+    return (char *)ptr - DSIZE - GET_SIZE(HDRP(ptr));
+}
+
+/*
+ * Mapped blocks are kept on map_list, doubly linked through the double
+ * word at the start of their mapping, so mm_reset can give them all back
+ */
+static void **map_links(void *ptr){
+    return (void **)map_base(ptr);
+}
+static void map_lock(void){
+#ifdef THREADS
+    pthread_mutex_lock(&map_mutex);
+#endif
+}
+static void map_unlock(void){
+#ifdef THREADS
+    pthread_mutex_unlock(&map_mutex);
+#endif
+}
+static void map_link(void *ptr){
+    map_lock();
+    map_links(ptr)[0] = NULL;
+    map_links(ptr)[1] = map_list;
+    if(map_list != NULL){
+        map_links(map_list)[0] = ptr;
+    }
+    map_list = ptr;
+    map_unlock();
+}
+static void map_unlink(void *ptr){
+    void *prev;
+    void *next;
+    map_lock();
+    prev = map_links(ptr)[0];
+    next = map_links(ptr)[1];
+    if(prev != NULL){
+        map_links(prev)[1] = next;
+    }else{
+        map_list = next;
+    }
+    if(next != NULL){
+        map_links(next)[0] = prev;
+    }
+    map_unlock();
+}
+
+/*
+ * Map alloc function
+ * Serves a huge request with pages of its own from memlib, outside the
+ * heap. The payload starts at the first multiple of alignment two double
+ * words into the mapping, behind the map_list links, the mapping length
+ * and a header with the MAPPED bit and the gap before the length as its
+ * size.
+ */
+static void *map_alloc(size_t alignment, size_t size){
+    size_t len = map_len(size + alignment);
+    char *base;
+    char *ptr;
+    if(len == 0 || (base = mm_map(len)) == NULL){
+        return NULL;
+    }
+    ptr = (char *)(((uintptr_t)base + 2*DSIZE + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    *(size_t *)(ptr - DSIZE) = len;
+    PUT(HDRP(ptr), PACK(ptr - DSIZE - base, MAPPED | 1));
+    map_link(ptr);
+    return ptr;
+}
+
+/*
+ * Map free function
+ * Gives a mapped block's pages straight back to memlib
+ */
+static void map_free(void *ptr){
+    map_unlink(ptr);
+    mm_unmap(map_base(ptr), map_size(ptr));
+}
+
+/*
+ * Returns whether ptr is a mapped block. Slots have no header of their
+ * own, so they are ruled out before the header is read.
+ */
+static bool is_mapped(void *ptr){
+#ifdef SLAB
+    if(in_slab(ptr)){
+        return false;
+    }
+#endif
+    return (GET(HDRP(ptr)) & MAPPED) != 0;
+}
+
+/*
+ * Map realloc function
+ * A mapped block that stays huge is resized by remapping its pages, which
+ * costs the pages added or dropped rather than a copy of the payload.
+ * One that shrinks below MMAP_THRESHOLD is copied back into the heap.
+ */
+static void *map_realloc(void *oldptr, size_t size){
+    size_t oldlen = map_size(oldptr);
+    size_t gap = GET_SIZE(HDRP(oldptr));
+    size_t oldsize = oldlen - DSIZE - gap;
+    size_t len;
+    char *base;
+    void *newptr;
+    if(size >= MMAP_THRESHOLD){
+        //The gap moves along with the pages, like realloc the block need not stay aligned
+        if((len = map_len(size + gap)) == 0){
+            return NULL;
+        }
+        if(len == oldlen){
+            return oldptr;
+        }
+        //The pages may move, take the block off map_list while they do
+        map_unlink(oldptr);
+        if((base = mm_remap(map_base(oldptr), oldlen, len)) == NULL){
+            map_link(oldptr);
+            return NULL;
+        }
+        *(size_t *)(base + gap) = len;
+        map_link(base + gap + DSIZE);
+        return base + gap + DSIZE;
+    }
+    if((newptr = malloc(size)) == NULL){
+        return NULL;
+    }
+    memcpy(newptr, oldptr, (size < oldsize) ? size : oldsize);
+    map_free(oldptr);
+    return newptr;
+}
+
+#ifdef SLAB
+/*
+ * Page index in the pagemap of the heap page holding ptr
+ */
+static size_t page_index(const heap_meta_t *arena, const void *ptr){
+    return ((size_t)((const char *)ptr - (const char *)arena)) / RUN_SIZE;
+}
+
+/*
+ * Run holding the slot ptr, runs are RUN_SIZE aligned
+ */
+static run_t *run_of(const void *ptr){
+    return (run_t *)((uintptr_t)ptr & ~(uintptr_t)(RUN_SIZE - 1));
+}
+
+/*
+ * Returns whether ptr is a slot inside a run
+ */
+static bool in_slab(const void *ptr){
+    heap_meta_t *arena = arena_of(ptr);
+    size_t page;
+    if(arena == NULL){
+        return false;
+    }
+    page = page_index(arena, ptr);
+    //Thread caches ask without the arena lock, so read the map the way grow_pagemap publishes it
+    if(page >= __atomic_load_n(&arena->pagemap_bits, __ATOMIC_ACQUIRE)){
+        return false;
+    }
+    return (__atomic_load_n(&arena->pagemap, __ATOMIC_ACQUIRE)[page / 64] >> (page % 64)) & 1;
+}
+
+/*
+ * Make the pagemap cover page, regrowing it in an ordinary block
+ */
+static bool grow_pagemap(size_t page){
+    size_t bits = MAX(2 * meta->pagemap_bits, align(page + 1) * 8);
+    uint64_t *pagemap = alloc_block(align(bits / 8 + WSIZE));
+    if(pagemap == NULL){
+        return false;
+    }
+    memset(pagemap, 0, bits / 8);
+    if(meta->pagemap != NULL){
+        memcpy(pagemap, meta->pagemap, meta->pagemap_bits / 8);
+#ifdef THREADS
+        //A thread cache may still be reading the old map without the lock, keep it
+#else
+        free_block(meta->pagemap, GET_SIZE(HDRP(meta->pagemap)));
+#endif
+    }
+    //Publish the map before the bits that let in_slab index into it
+    __atomic_store_n(&meta->pagemap, pagemap, __ATOMIC_RELEASE);
+    __atomic_store_n(&meta->pagemap_bits, bits, __ATOMIC_RELEASE);
+    return true;
+}
+
+/*
+ * Unlink a run from its class list
+ */
+static void unlink_run(run_t *run, int cls){
+    if(run->prev != NULL){
+        run->prev->next = run->next;
+    }else{
+        meta->slab_runs[cls] = run->next;
+    }
+    if(run->next != NULL){
+        run->next->prev = run->prev;
+    }
+}
+
+/*
+ * Push a run in front of its class list
+ */
+static void push_run(run_t *run, int cls){
+    run->prev = NULL;
+    run->next = meta->slab_runs[cls];
+    if(run->next != NULL){
+        run->next->prev = run;
+    }
+    meta->slab_runs[cls] = run;
+}
+
+/*
+ * Carve a new run for class cls out of an aligned ordinary block
+ */
+static run_t *new_run(int cls){
+    run_t *run = alloc_aligned(RUN_SIZE, RUN_SIZE);
+    size_t page, nslots, w;
+    if(run == NULL){
+        return NULL;
+    }
+    page = page_index(meta, run);
+    if(page >= meta->pagemap_bits && !grow_pagemap(page)){
+        free_block(run, RUN_SIZE);
+        return NULL;
+    }
+    __atomic_fetch_or(&meta->pagemap[page / 64], 1ULL << (page % 64), __ATOMIC_RELAXED);
+    run->slot = (cls + 1) * DSIZE;
+    nslots = RUN_SLOTS / run->slot;
+    run->nfree = nslots;
+    for(w = 0; w < 4; w++){
+        if(nslots >= 64){
+            run->freemap[w] = ~0ULL;
+            nslots -= 64;
+        }else{
+            run->freemap[w] = (1ULL << nslots) - 1;
+            nslots = 0;
+        }
+    }
+    push_run(run, cls);
+    return run;
+}
+
+/*
+ * Slab allocate: hand out the first free slot of the first run with room
+ */
+static void *slab_alloc(size_t size){
+    int cls = (size - 1) / DSIZE;
+    run_t *run = meta->slab_runs[cls];
+    int w = 0;
+    int bit;
+    if(run == NULL && (run = new_run(cls)) == NULL){
+        return NULL;
+    }
+    while(run->freemap[w] == 0){
+        w++;
+    }
+    bit = __builtin_ctzll(run->freemap[w]);
+    run->freemap[w] &= ~(1ULL << bit);
+    //A full run leaves the list until a slot comes back
+    if(--run->nfree == 0){
+        unlink_run(run, cls);
+    }
+    return (char *)run + RUN_HDR + (size_t)(w * 64 + bit) * run->slot;
+}
+
+/*
+ * Slab free: set the slot's bit, return the run once it is empty
+ */
+static void slab_free(void *ptr){
+    run_t *run = run_of(ptr);
+    int cls = run->slot / DSIZE - 1;
+    size_t idx = ((char *)ptr - (char *)run - RUN_HDR) / run->slot;
+    size_t page;
+    run->freemap[idx / 64] |= (1ULL << (idx % 64));
+    if(run->nfree++ == 0){
+        push_run(run, cls);
+    }
+    //Keep the last run of a class around, give any other empty one back to the heap
+    if(run->nfree == RUN_SLOTS / run->slot
+       && (run->prev != NULL || run->next != NULL)){
+        unlink_run(run, cls);
+        page = page_index(meta, run);
+        __atomic_fetch_and(&meta->pagemap[page / 64], ~(1ULL << (page % 64)), __ATOMIC_RELAXED);
+        free_block(run, RUN_SIZE);
+    }
+}
+#endif // SLAB
+
+/*
+ * Heap malloc function
+ * Serves a request from a slab run or the free lists, caller holds the lock
+ */
+static void *heap_malloc(size_t size){
+#ifdef SLAB
+    //Small payloads come from a run slot, once their class fills a run
+    if(size <= SLAB_MAX){
+        int cls = (size - 1) / DSIZE;
+        if(meta->slab_asked[cls] >= RUN_COUNT(cls)){
+            return slab_alloc(size);
+        }
+        meta->slab_asked[cls]++;
+    }
+#endif
+    //Huge payloads get pages of their own
+    if(size >= MMAP_THRESHOLD){
+        return map_alloc(DSIZE, size);
+    }
+    //Adjust block size to include overhead and alignment requests
+    //Allocated blocks only carry a header, 1-8 byte payloads fit a mini-block
+    return alloc_block(align(size + WSIZE));
+}
+
+/*
+ * Block free function
+ * Frees the ordinary block ptr of size bytes, caller holds the lock
+ */
+static void block_free(void *ptr, size_t size){
+    //Small blocks wait in a fastbin for a malloc of the same size, unless
+    //they end the heap, where they would keep the top from being trimmed
+    if(size <= FAST_MAX && !ends_heap(ptr, size)){
+        fast_free(ptr, size);
+        return;
+    }
+    free_block(ptr, size);
+}
+
+/*
+ * Heap free function
+ * Returns a slot to its run or a block to the free lists, caller holds the lock
+ */
+static void heap_free(void *ptr){
+#ifdef SLAB
+    if(in_slab(ptr)){
+        slab_free(ptr);
+        return;
+    }
+#endif
+    block_free(ptr, GET_SIZE(HDRP(ptr)));
+}
+
+/*
+ * Carve function
+ * Places as many asize byte blocks back to back in the free block ptr as
+ * it holds, up to n, storing them in out. Returns how many.
+ */
+static size_t carve(void *ptr, size_t asize, size_t n, void **out){
+    size_t k = GET_SIZE(HDRP(ptr)) / asize;
+    size_t total;
+    size_t i;
+    if(k > n){
+        k = n;
+    }
+    place(ptr, k * asize);
+    total = GET_SIZE(HDRP(ptr));
+    for(i = 0; i + 1 < k; i++){
+        PUT(HDRP(ptr), PACK(asize, GET_PREV_BITS(HDRP(ptr)) | 1));
+        out[i] = ptr;
+        ptr = NEXT_BLKP(ptr);
+        PUT(HDRP(ptr), PACK(total - (i + 1) * asize,
+                            PREV_ALLOC | (asize == MINISIZE ? PREV_MINI : 0) | 1));
+    }
+    out[k - 1] = ptr;
+    //place judged the successor by the whole span, the last block is what it follows
+    SET_PREV_MINI(HDRP(NEXT_BLKP(ptr)), (GET_SIZE(HDRP(ptr)) == MINISIZE) ? PREV_MINI : 0);
+    return k;
+}
+
+/*
+ * Heap malloc batch function
+ * Serves n requests of size bytes into out, carving ordinary blocks out
+ * of as few fits or extensions as it can, caller holds the lock. Returns
+ * how many it served.
+ */
+static size_t heap_malloc_batch(size_t size, size_t n, void **out){
+    size_t got = 0;
+    size_t asize, want;
+    void *ptr;
+    bool single = size >= MMAP_THRESHOLD;
+#ifdef SLAB
+    single = single || size <= SLAB_MAX;
+#endif
+    //Slots and mapped blocks gain nothing from a shared fit
+    if(single){
+        while(got < n && (out[got] = heap_malloc(size)) != NULL){
+            got++;
+        }
+        return got;
+    }
+    asize = align(size + WSIZE);
+    //Fastbin blocks of the exact size go first
+    while(got < n && asize <= FAST_MAX && meta->fastbins[asize / DSIZE - 1] != NULL){
+        out[got++] = alloc_block(asize);
+    }
+    while(got < n){
+        //Look for room for everything left at once, at most MMAP_THRESHOLD bytes of it,
+        //then for any room at all, then grow the heap
+        want = n - got;
+        if(want > MMAP_THRESHOLD / asize){
+            want = MMAP_THRESHOLD / asize;
+        }
+        if((ptr = find_fit(want * asize)) == NULL
+           && (!consolidate() || (ptr = find_fit(want * asize)) == NULL)
+           && (ptr = find_fit(asize)) == NULL
+           && (ptr = grow_heap(want * asize)) == NULL){
+            break;
+        }
+        got += carve(ptr, asize, n - got, out + got);
+    }
+    return got;
+}
+
+#ifdef THREADS
+/*
+ * Thread cache
+ * Each thread keeps LIFO bins of the blocks it frees, still allocated as
+ * far as the heap knows, and serves mallocs of the same bin from them
+ * without the lock. There is a bin per slab class, then one per block
+ * size up to TCACHE_MAX. An empty bin is refilled and a full one flushed
+ * TCACHE_BATCH blocks at a time under a single lock. A thread's cache is
+ * drained when it exits and dropped when mm_init starts a new heap.
+ */
+#ifdef SLAB
+#define TCACHE_SLAB SLAB_CLASSES //Bins ahead of the block size bins
+#else
+#define TCACHE_SLAB 0
+#endif
+#define TCACHE_MAX 1024 //Largest block size cached
+#define TCACHE_BINS (TCACHE_SLAB + TCACHE_MAX / DSIZE)
+#define TCACHE_BATCH 8 //Blocks moved between a bin and the heap at once
+#define TCACHE_LIMIT (2 * TCACHE_BATCH) //Most blocks a bin holds
+
+typedef struct {
+    void *bin[TCACHE_BINS]; //cached payloads linked through their first word
+    uint32_t count[TCACHE_BINS];
+} tcache_t;
+
+static __thread tcache_t *tcache; //the calling thread's cache, kept in the heap
+static __thread uint64_t tcache_epoch; //heap_epoch tcache was made in
+static __thread heap_meta_t *home; //arena the thread allocates from
+static __thread uint64_t home_epoch; //heap_epoch home was picked in
+static uint64_t heap_epoch; //bumped by mm_init, caches and arenas from older heaps are stale
+static pthread_key_t tcache_key; //runs tcache_drain at thread exit
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+
+static bool arena_init(int region);
+
+/*
+ * Make arena the one the thread works in and take its lock
+ */
+static void heap_lock(heap_meta_t *arena){
+    meta = arena;
+    pthread_mutex_lock(&meta->lock);
+}
+static void heap_unlock(void){
+    pthread_mutex_unlock(&meta->lock);
+}
+
+/*
+ * The arena the calling thread allocates from. Threads are handed the
+ * arenas round-robin, an arena is laid out by the first thread given it.
+ */
+static heap_meta_t *arena_home(void){
+    heap_meta_t *first = mm_region_lo(0);
+    int region;
+    if(home != NULL && home_epoch == heap_epoch){
+        return home;
+    }
+    region = __atomic_fetch_add(&first->next_arena, 1, __ATOMIC_RELAXED) % MM_ARENAS;
+    //Arena 0's lock also serializes laying out the others
+    heap_lock(first);
+    if(!(first->arenas_ready & (1U << region))){
+        //A region left part laid out by a failed attempt is not tried again
+        if((char *)mm_region_hi(region) + 1 == (char *)mm_region_lo(region) && arena_init(region)){
+            first->arenas_ready |= (1U << region);
+        }else{
+            region = 0;
+        }
+    }
+    meta = first;
+    heap_unlock();
+    home = mm_region_lo(region);
+    home_epoch = heap_epoch;
+    return home;
+}
+
+/*
+ * Bin serving a malloc of size, -1 when the request bypasses the cache
+ */
+static int tcache_bin(size_t size){
+#ifdef SLAB
+    if(size <= SLAB_MAX){
+        return (size - 1) / DSIZE;
+    }
+#endif
+    if(size > TCACHE_MAX - WSIZE){
+        return -1;
+    }
+    return TCACHE_SLAB + align(size + WSIZE) / DSIZE - 1;
+}
+
+/*
+ * Bin an allocated slot or block belongs to, -1 when it is not cached
+ */
+static int tcache_block_bin(void *ptr){
+#ifdef SLAB
+    if(in_slab(ptr)){
+        return run_of(ptr)->slot / DSIZE - 1;
+    }
+#endif
+    if((GET(HDRP(ptr)) & MAPPED) || GET_SIZE(HDRP(ptr)) > TCACHE_MAX){
+        return -1;
+    }
+    return TCACHE_SLAB + GET_SIZE(HDRP(ptr)) / DSIZE - 1;
+}
+
+/*
+ * Cached blocks come from every arena, so unlike free list links theirs
+ * are whole pointers, which fit every payload
+ */
+static void *tcache_next(void *ptr){
+    return *(void **)ptr;
+}
+static void tcache_link(void *ptr, void *next){
+    *(void **)ptr = next;
+}
+
+/*
+ * Hand the n most recently cached blocks of bin back to the heap
+ */
+static void tcache_flush(int bin, uint32_t n){
+    heap_meta_t *arena = NULL;
+    void *ptr;
+    while(n-- > 0 && (ptr = tcache->bin[bin]) != NULL){
+        tcache->bin[bin] = tcache_next(ptr);
+        tcache->count[bin]--;
+        //Blocks freed here may come from any arena, each goes back to its own
+        if(arena_of(ptr) != arena){
+            if(arena != NULL){
+                heap_unlock();
+            }
+            heap_lock(arena = arena_of(ptr));
+        }
+        heap_free(ptr);
+    }
+    if(arena != NULL){
+        heap_unlock();
+    }
+}
+
+/*
+ * Cache ptr in bin, a full bin hands a batch back first
+ */
+static void tcache_put(int bin, void *ptr){
+    if(tcache->count[bin] == TCACHE_LIMIT){
+        tcache_flush(bin, TCACHE_BATCH);
+    }
+    tcache_link(ptr, tcache->bin[bin]);
+    tcache->bin[bin] = ptr;
+    tcache->count[bin]++;
+}
+
+/*
+ * Take a batch for an empty bin from the heap, returns one of its blocks
+ */
+static void *tcache_refill(int bin){
+    void *first;
+    void *ptr;
+    int n;
+    heap_lock(arena_home());
+    for(n = 0, first = NULL; n < TCACHE_BATCH; n++){
+        //Slab bins hold slots only, free_sized relies on it
+        if(bin < TCACHE_SLAB){
+            ptr = slab_alloc((bin + 1) * DSIZE);
+        }else{
+            ptr = alloc_block((bin - TCACHE_SLAB + 1) * DSIZE);
+        }
+        if(ptr == NULL){
+            break;
+        }
+        if(first == NULL){
+            first = ptr;
+        }else{
+            tcache_link(ptr, tcache->bin[bin]);
+            tcache->bin[bin] = ptr;
+            tcache->count[bin]++;
+        }
+    }
+    heap_unlock();
+    return first;
+}
+
+/*
+ * Thread exit: every cached block and the cache itself go back to the heap
+ */
+static void tcache_drain(void *cache){
+    int bin;
+    //A cache from before the last mm_init or mm_reset went away with its heap
+    if(cache != tcache || tcache_epoch != heap_epoch){
+        return;
+    }
+    for(bin = 0; bin < TCACHE_BINS; bin++){
+        tcache_flush(bin, tcache->count[bin]);
+    }
+    heap_lock(arena_of(tcache));
+    free_block(tcache, GET_SIZE(HDRP(tcache)));
+    heap_unlock();
+    tcache = NULL;
+}
+
+static void tcache_key_init(void){
+    pthread_key_create(&tcache_key, tcache_drain);
+}
+
+/*
+ * The calling thread's cache, made on first use. NULL when the heap has
+ * no room for one, then the thread goes to the heap every time.
+ */
+static tcache_t *tcache_get(void){
+    if(tcache != NULL && tcache_epoch == heap_epoch){
+        return tcache;
+    }
+    pthread_once(&tcache_once, tcache_key_init);
+    heap_lock(arena_home());
+    tcache = alloc_block(align(sizeof(tcache_t) + WSIZE));
+    heap_unlock();
+    if(tcache != NULL){
+        memset(tcache, 0, sizeof(tcache_t));
+        tcache_epoch = heap_epoch;
+        pthread_setspecific(tcache_key, tcache);
+    }
+    return tcache;
+}
+#else
+//Single threaded builds have the one arena and take no lock
+static void heap_lock(heap_meta_t *arena){
+}
+static void heap_unlock(void){
+}
+static heap_meta_t *arena_home(void){
+    return meta;
+}
+#endif // THREADS
+
+/*
+ * Moves the lock from arena held, if any, to arena, returns arena
+ */
+static heap_meta_t *relock(heap_meta_t *held, heap_meta_t *arena){
+    if(arena != held){
+        if(held != NULL){
+            heap_unlock();
+        }
+        heap_lock(arena);
+    }
+    return arena;
+}
+
+/*
+ * Arena clear function
+ * Empties every free structure of the arena meta points at, as for a
+ * heap holding no blocks
+ */
+static void arena_clear(void){
+    //Initialize segfree list
+#ifdef TLSF
+    meta->fl_map = 0;
+    for(int fl = 0; fl < FL_COUNT; fl++){
+        meta->sl_map[fl] = 0;
+    }
+#else
+    meta->classmap = 0;
+#endif
+    meta->mini_list = NULL;
+    for(int listpos = 0; listpos < totalTrace; listpos++){
+        meta->segfree_list[listpos] = NULL;
+    }
+    for(int bin = 0; bin < FAST_BINS; bin++){
+        meta->fastbins[bin] = NULL;
+    }
+    meta->fastmap = 0;
+    meta->fast_bytes = 0;
+    meta->grow_step = CHUNKSIZE;
+    meta->grow_clock = 0;
+    meta->top = NULL;
+    meta->clean_top = NULL;
+    meta->fresh = NULL;
+#ifdef SLAB
+    for(int cls = 0; cls < SLAB_CLASSES; cls++){
+        meta->slab_runs[cls] = NULL;
+        meta->slab_asked[cls] = 0;
+    }
+    meta->pagemap = NULL;
+    meta->pagemap_bits = 0;
+#endif
+}
+
+/*
+ * Arena init function
+ * Lays out an empty arena at the bottom of a memlib region: the arena
+ * state, then the prologue and epilogue, then a first free chunk. Leaves
+ * meta pointing at it.
+ */
+static bool arena_init(int region){
+    char *heap_listp;
+    //Reserve the allocator state at the bottom of the region
+    if ((long)(meta = mm_sbrk_region(region, align(sizeof(heap_meta_t)))) == -1){
+        return false;
+    }
+    meta->region = region;
+    arena_clear();
+#ifdef THREADS
+    pthread_mutex_init(&meta->lock, NULL);
+#endif
+    //Create the initial empty heap, alignment padding then a double word prologue block
+    if ((long)(heap_listp = mm_sbrk_region(region, 2*DSIZE)) == -1){
+        return false;
+    }
+    heap_listp += DSIZE;
+    PUT(HDRP(heap_listp), PACK(DSIZE, 1)); //Prologue header
+    PUT(FTRP(heap_listp), PACK(DSIZE, 1)); //Prologue footer
+    PUT(HDRP(NEXT_BLKP(heap_listp)), PACK(0, PREV_ALLOC | 1)); //Epilogue header
+
+    //Extend the empty heap with a free block of CHUNKSIZE bytes
+    if(extend_heap(CHUNKSIZE) == NULL){
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Arena reset function
+ * Returns the arena meta points at to the state arena_init left it in,
+ * giving back the break past the prologue rather than freeing blocks
+ */
+static bool arena_reset(void){
+    char *heap_listp = (char *)meta + align(sizeof(heap_meta_t)) + DSIZE; //the arena's prologue
+    char *brk = (char *)mm_region_hi(meta->region) + 1;
+    arena_clear();
+    if((long)mm_sbrk_region(meta->region, -(intptr_t)(brk - (heap_listp + DSIZE))) == -1){
+        return false;
+    }
+    PUT(HDRP(NEXT_BLKP(heap_listp)), PACK(0, PREV_ALLOC | 1)); //Epilogue header
+    return extend_heap(CHUNKSIZE) != NULL;
+}
+
+/*
+ * mm_init: returns false on error, true on success.
+ */
+bool mm_init(void)
+{
+    // IMPLEMENT THIS
+    mm_checkheap(__LINE__);
+    //memlib has dropped every mapping along with the heap
+    map_list = NULL;
+    //Arena 0 starts the heap, the others are laid out as threads need them
+    if(!arena_init(0)){
+        return false;
+    }
+#ifdef THREADS
+    meta->next_arena = 0;
+    meta->arenas_ready = 1;
+    heap_epoch++;
+#endif
+    return true;
+}
+
+/*
+ * mm_reset: discards every block, mapped ones included, and leaves the
+ * heap as mm_init does, in time bound by the arenas and size classes
+ * rather than the blocks. No other thread may be using the heap.
+ * Returns false on error, true on success.
+ */
+bool mm_reset(void)
+{
+    void *ptr;
+    mm_checkheap(__LINE__);
+    while((ptr = map_list) != NULL){
+        map_free(ptr);
+    }
+#ifdef THREADS
+    //The other arenas give back their whole region, to be laid out again as threads need them
+    for(int region = 1; region < MM_ARENAS; region++){
+        char *brk = (char *)mm_region_hi(region) + 1;
+        if((long)mm_sbrk_region(region, -(intptr_t)(brk - (char *)mm_region_lo(region))) == -1){
+            return false;
+        }
+    }
+    meta = mm_region_lo(0);
+    meta->next_arena = 0;
+    meta->arenas_ready = 1;
+    //Thread caches and home arenas are dropped as after mm_init
+    heap_epoch++;
+#endif
+    return arena_reset();
+}
+
+/*
+ * Scoped arenas: chunks malloc'd from the heap and bumped through
+ * ALIGNMENT bytes at a time. Their blocks are never freed one by one,
+ * a reset gives back every chunk but the first, which holds the
+ * mm_arena itself, and destroy gives back that one too. A request of a
+ * chunk or more gets a chunk of its own and the current one is kept.
+ */
+#define SCOPE_CHUNK (1<<14) //Chunk bytes of a scoped arena created with size 0
+
+struct mm_arena {
+    void *chunks; //chunks after the first, linked through their first word
+    char *cur; //next free byte of the chunk being bumped
+    char *end; //end of that chunk
+    size_t chunk; //payload bytes per chunk
+};
+
+/*
+ * mm_arena_create: a scoped arena whose chunks hold size bytes, or
+ * SCOPE_CHUNK for 0. NULL when the heap is out of memory.
+ */
+mm_arena_t *mm_arena_create(size_t size)
+{
+    mm_arena_t *arena;
+    if(size > SIZE_MAX - 2*DSIZE - sizeof(mm_arena_t)){
+        return NULL;
+    }
+    size = align(size ? size : SCOPE_CHUNK);
+    if((arena = malloc(align(sizeof(mm_arena_t)) + size)) == NULL){
+        return NULL;
+    }
+    arena->chunks = NULL;
+    arena->chunk = size;
+    mm_arena_reset(arena);
+    return arena;
+}
+
+/*
+ * mm_arena_alloc: size bytes from the scoped arena, ALIGNMENT aligned,
+ * NULL for 0 or when the heap is out of memory
+ */
+void *mm_arena_alloc(mm_arena_t *arena, size_t size)
+{
+    char *ptr;
+    char *chunk;
+    if(size == 0 || size > SIZE_MAX - DSIZE - arena->chunk){
+        return NULL;
+    }
+    size = align(size);
+    if(size <= (size_t)(arena->end - arena->cur)){
+        ptr = arena->cur;
+        arena->cur += size;
+        return ptr;
+    }
+    if((chunk = malloc(DSIZE + MAX(size, arena->chunk))) == NULL){
+        return NULL;
+    }
+    *(void **)chunk = arena->chunks;
+    arena->chunks = chunk;
+    ptr = chunk + DSIZE;
+    if(size < arena->chunk){
+        arena->cur = ptr + size;
+        arena->end = ptr + arena->chunk;
+    }
+    return ptr;
+}
+
+/*
+ * mm_arena_reset: drops every block of the scoped arena at once
+ */
+void mm_arena_reset(mm_arena_t *arena)
+{
+    void *chunk;
+    while((chunk = arena->chunks) != NULL){
+        arena->chunks = *(void **)chunk;
+        free(chunk);
+    }
+    arena->cur = (char *)arena + align(sizeof(mm_arena_t));
+    arena->end = arena->cur + arena->chunk;
+}
+
+/*
+ * mm_arena_destroy: drops every block of the scoped arena and the arena
+ */
+void mm_arena_destroy(mm_arena_t *arena)
+{
+    mm_arena_reset(arena);
+    free(arena);
+}
+
+/*
+ * Pools: slots of one size in chunks drawn from the heap with memalign,
+ * each chunk aligned to its own power of two size so a slot finds its
+ * chunk by masking. Like runs, a chunk is a block of exactly that size
+ * with its header in front, so back to back chunks tile. A chunk hands out
+ * slots from a bump pointer until it has been through them all, then from
+ * an intrusive list of the ones freed. Chunks with free slots are on the
+ * pool's partial list, the rest on its full list. A chunk that empties
+ * goes back to the heap, unless it is the pool's last one with free slots.
+ * A pool is used by one thread at a time.
+ */
+#define POOL_CHUNK 4096 //Smallest chunk bytes
+#define POOL_SLOTS 16 //Fewest slots per chunk, bigger objects get bigger chunks
+
+typedef struct pool_chunk {
+    struct pool_chunk *next; //chunks on the same list of the pool
+    struct pool_chunk *prev;
+    void *free; //freed slots, linked through their first word
+    char *bump; //first slot never handed out
+    size_t used; //slots handed out
+} pool_chunk_t;
+
+struct mm_pool {
+    pool_chunk_t *partial; //chunks with free slots
+    pool_chunk_t *full; //chunks without
+    size_t slot; //slot bytes, a multiple of the alignment
+    size_t first; //offset of the first slot in a chunk
+    size_t chunk; //chunk bytes with the block header, a power of two
+    size_t slots; //slots per chunk
+};
+
+static void pool_push(pool_chunk_t **list, pool_chunk_t *chunk){
+    chunk->prev = NULL;
+    chunk->next = *list;
+    if(*list != NULL){
+        (*list)->prev = chunk;
+    }
+    *list = chunk;
+}
+static void pool_unlink(pool_chunk_t **list, pool_chunk_t *chunk){
+    if(chunk->prev != NULL){
+        chunk->prev->next = chunk->next;
+    }else{
+        *list = chunk->next;
+    }
+    if(chunk->next != NULL){
+        chunk->next->prev = chunk->prev;
+    }
+}
+
+/*
+ * mm_pool_create: a pool of object_size byte objects on multiples of
+ * alignment, a power of two, ALIGNMENT for 0 and at least a pointer.
+ * NULL for a bad alignment or when the heap is out of memory.
+ */
+mm_pool_t *mm_pool_create(size_t object_size, size_t alignment)
+{
+    mm_pool_t *pool;
+    size_t chunk = POOL_CHUNK;
+    if(alignment == 0){
+        alignment = ALIGNMENT;
+    }
+    if((alignment & (alignment - 1)) != 0 || object_size > MMAP_THRESHOLD
+       || alignment > MMAP_THRESHOLD){
+        return NULL;
+    }
+    alignment = MAX(alignment, sizeof(void *));
+    if((pool = malloc(sizeof(mm_pool_t))) == NULL){
+        return NULL;
+    }
+    pool->slot = (MAX(object_size, sizeof(void *)) + alignment - 1) & ~(alignment - 1);
+    pool->first = (sizeof(pool_chunk_t) + alignment - 1) & ~(alignment - 1);
+    while(chunk < WSIZE + pool->first + POOL_SLOTS * pool->slot){
+        chunk *= 2;
+    }
+    pool->chunk = chunk;
+    pool->slots = (chunk - WSIZE - pool->first) / pool->slot;
+    pool->partial = NULL;
+    pool->full = NULL;
+    return pool;
+}
+
+/*
+ * mm_pool_alloc: an object from the pool, NULL when the heap is out of memory
+ */
+void *mm_pool_alloc(mm_pool_t *pool)
+{
+    pool_chunk_t *chunk = pool->partial;
+    void *ptr;
+    if(chunk == NULL){
+        if((chunk = mm_memalign(pool->chunk, pool->chunk - WSIZE)) == NULL){
+            return NULL;
+        }
+        chunk->free = NULL;
+        chunk->bump = (char *)chunk + pool->first;
+        chunk->used = 0;
+        pool_push(&pool->partial, chunk);
+    }
+    if(chunk->bump < (char *)chunk + pool->first + pool->slots * pool->slot){
+        ptr = chunk->bump;
+        chunk->bump += pool->slot;
+    }else{
+        ptr = chunk->free;
+        chunk->free = *(void **)ptr;
+    }
+    if(++chunk->used == pool->slots){
+        pool_unlink(&pool->partial, chunk);
+        pool_push(&pool->full, chunk);
+    }
+    return ptr;
+}
+
+/*
+ * mm_pool_free: returns an object to the pool it came from
+ */
+void mm_pool_free(mm_pool_t *pool, void *ptr)
+{
+    pool_chunk_t *chunk;
+    if(ptr == NULL){
+        return;
+    }
+    chunk = (pool_chunk_t *)((uintptr_t)ptr & ~(uintptr_t)(pool->chunk - 1));
+    *(void **)ptr = chunk->free;
+    chunk->free = ptr;
+    if(chunk->used-- == pool->slots){
+        pool_unlink(&pool->full, chunk);
+        pool_push(&pool->partial, chunk);
+    }
+    if(chunk->used == 0 && (chunk->prev != NULL || chunk->next != NULL)){
+        pool_unlink(&pool->partial, chunk);
+        free(chunk);
+    }
+}
+
+/*
+ * mm_pool_destroy: gives the pool and every chunk of it back to the heap
+ */
+void mm_pool_destroy(mm_pool_t *pool)
+{
+    pool_chunk_t *chunk;
+    while((chunk = pool->partial) != NULL){
+        pool->partial = chunk->next;
+        free(chunk);
+    }
+    while((chunk = pool->full) != NULL){
+        pool->full = chunk->next;
+        free(chunk);
+    }
+    free(pool);
+}
+
+/*
+ * malloc
+ */
+void* malloc(size_t size)
+{
+    // IMPLEMENT THIS
+    mm_checkheap(__LINE__);
+    // Find space, free size of heap, multiple heap block, allocate, find free block, use, else create new block
+    void *ptr;
+    //Ignore requests if empty
+    if(size == 0){
+        return NULL;
+    }
+#ifdef THREADS
+    //Small requests come from the thread cache, refilled from the heap when it runs dry
+    int bin = tcache_bin(size);
+    if(bin >= 0 && tcache_get() != NULL){
+        if((ptr = tcache->bin[bin]) == NULL){
+            return tcache_refill(bin);
+        }
+        tcache->bin[bin] = tcache_next(ptr);
+        tcache->count[bin]--;
+        return ptr;
+    }
+#endif
+    heap_lock(arena_home());
+    ptr = heap_malloc(size);
+    heap_unlock();
+    return ptr;
+}
+
+/*
+ * free
+ */
+void free(void* ptr)
+{
+    // IMPLEMENT THIS
+    mm_checkheap(__LINE__);
+    if(ptr == NULL){
+        return;
+    }
+#ifdef THREADS
+    //Keep the block in the thread cache, a full bin hands a batch back first
+    int bin = tcache_block_bin(ptr);
+    if(bin >= 0 && tcache_get() != NULL){
+        tcache_put(bin, ptr);
+        return;
+    }
+#endif
+    //Mapped blocks go straight back to memlib without a lock
+    if(is_mapped(ptr)){
+        map_free(ptr);
+        return;
+    }
+    //free block, write implementation add back to free list, in the arena it came from
+    heap_lock(arena_of(ptr));
+    heap_free(ptr);
+    heap_unlock();
+}
+
+/*
+ * Heap realloc function
+ * Resizes a live slot or block, in place when possible, caller holds the lock
+ */
+static void *heap_realloc(void *oldptr, size_t size){
+    size_t oldsize;
+    void* newptr;
+    size_t asize;
+#ifdef SLAB
+    //A slot keeps the pointer while the new size still fits in it
+    if(in_slab(oldptr)){
+        oldsize = run_of(oldptr)->slot;
+        if(size <= oldsize){
+            return oldptr;
+        }
+        if((newptr = heap_malloc(size)) == NULL){
+            return NULL;
+        }
+        memcpy(newptr, oldptr, oldsize);
+        slab_free(oldptr);
+        return newptr;
+    }
+#endif
+    //Grow or shrink without copying whenever the neighbours allow it
+    asize = align(size + WSIZE);
+    if((newptr = resize_in_place(oldptr, asize)) != NULL){
+        return newptr;
+    }
+    newptr = heap_malloc(size);
+    //Create a size of the input size and copy over
+    if(newptr == NULL){
+        return NULL;
+    }else{
+        //Get oldptr size, copy over oldptr size to newly created size ptr, deallocates the oldptr
+        oldsize = GET_SIZE(HDRP(oldptr)) - WSIZE;
+        if(oldsize > size){
+            oldsize = size;
+        }
+        memcpy(newptr, oldptr, oldsize);
+        free_block(oldptr, GET_SIZE(HDRP(oldptr)));
+    }
+    return (newptr);
+}
+
+/*
+ * free sized
+ * Frees ptr given the size it was last malloced or realloced with, so an
+ * ordinary block's size comes from the caller rather than its header.
+ * Slots are told apart by their page and mapped blocks by their address,
+ * neither of which reads the block. Debug builds check the size against
+ * the header.
+ */
+void mm_free_sized(void *ptr, size_t size)
+{
+    size_t asize;
+    mm_checkheap(__LINE__);
+    if(ptr == NULL){
+        return;
+    }
+#ifdef SLAB
+    if(in_slab(ptr)){
+        dbg_assert(size <= run_of(ptr)->slot);
+#ifdef THREADS
+        if(tcache_get() != NULL){
+            tcache_put(tcache_block_bin(ptr), ptr);
+            return;
+        }
+#endif
+        heap_lock(arena_of(ptr));
+        slab_free(ptr);
+        heap_unlock();
+        return;
+    }
+#endif
+    if(mm_region_of(ptr) < 0){
+        dbg_assert(GET(HDRP(ptr)) & MAPPED);
+        map_free(ptr);
+        return;
+    }
+    //Every ordinary block is cut to exactly the size its last request asked for
+    asize = align(size + WSIZE);
+    dbg_assert(GET_SIZE(HDRP(ptr)) == asize && GET_ALLOC(HDRP(ptr)));
+#ifdef THREADS
+    if(asize <= TCACHE_MAX && tcache_get() != NULL){
+        tcache_put(TCACHE_SLAB + asize / DSIZE - 1, ptr);
+        return;
+    }
+#endif
+    heap_lock(arena_of(ptr));
+    block_free(ptr, asize);
+    heap_unlock();
+}
+
+/*
+ * Usable size function
+ * Payload bytes of a live slot or block: a whole slot, a block less its
+ * header, or a mapping less what precedes the payload
+ */
+static size_t usable_size(void *ptr){
+#ifdef SLAB
+    if(in_slab(ptr)){
+        return run_of(ptr)->slot;
+    }
+#endif
+    if(GET(HDRP(ptr)) & MAPPED){
+        return map_size(ptr) - DSIZE - GET_SIZE(HDRP(ptr));
+    }
+    return GET_SIZE(HDRP(ptr)) - WSIZE;
+}
+
+/*
+ * usable size
+ * Bytes the caller may use at ptr, the request rounded up to its block
+ * or slot, 0 for NULL
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if(ptr == NULL){
+        return 0;
+    }
+    return usable_size(ptr);
+}
+
+/*
+ * fit scan
+ * Sets how many blocks find_fit looks at in the list holding size byte
+ * blocks, or in every list for size 0; k of 0 looks at the whole list.
+ * Fails for sizes kept in the tree, which is searched best fit anyway,
+ * and with TLSF, whose lists all fit once rounded up.
+ */
+int mm_fit_scan(size_t size, unsigned k)
+{
+#ifdef TREE_LIST
+    int listpos;
+    if(k > FIT_SCAN_MAX){
+        return -1;
+    }
+    if(size == 0){
+        memset(fit_scan, k, sizeof(fit_scan));
+        return 0;
+    }
+    listpos = findList(size);
+    if(listpos == TREE_LIST){
+        return -1;
+    }
+    fit_scan[listpos] = k;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+/*
+ * realloc
+ */
+void* realloc(void* oldptr, size_t size)
 {
-#ifdef DEBUG
-    // Write code to check heap invariants here
     // IMPLEMENT THIS
-    int listpos = 0;
+    mm_checkheap(__LINE__);
+    void* newptr;
+    size_t usable;
+    // Check if oldptr is empty, then if it does, we just recurrsively calls malloc function
+    if(oldptr == NULL){
+        return malloc(size);
+    }
+    //Check if size has any value, if it doesn't then it would just deallocates the oldptr passed into the realloc function
+    if(size == 0){
+        free(oldptr);
+        return NULL;
+    }
+    //The slack already holds the new size and shrinking would free less than a block,
+    //so nothing moves and no lock is needed
+    usable = usable_size(oldptr);
+    if(size <= usable && usable - size < DSIZE){
+        return oldptr;
+    }
+    if(is_mapped(oldptr)){
+        return map_realloc(oldptr, size);
+    }
+    heap_lock(arena_of(oldptr));
+    newptr = heap_realloc(oldptr, size);
+    heap_unlock();
+    return newptr;
+}
 
-    //Find list position
-    while (segfree_list[listpos] == NULL && (listpos < totalTrace - 1)){
-        //asize shift 1 to right and increase list position
-        listpos += 1;
+/*
+ * calloc
+ * Fails when nmemb * size overflows. Memory memlib has just handed out
+ * is already zero, so a block cut from the clean top of the heap only
+ * has the free list words clearing, as does a huge block on its own
+ * pages. Small requests take the usual path and a memset.
+ */
+void* calloc(size_t nmemb, size_t size)
+{
+    void* ptr;
+    char* end;
+    bool fresh;
+    if(nmemb != 0 && size > SIZE_MAX / nmemb){
+        return NULL;
     }
-    //Check if the pointer is exist in the heap
-    if(in_heap(heap_listp) == true){
-        dbg_printf("Pointer %p exist in the heap!\n", heap_listp);
-        heap_listp = NEXT_BLKP(heap_listp);
-    }else{
-        dbg_printf("ERROR: Pointer %p not in the heap!\n", heap_listp);
+    size *= nmemb;
+    if(size <= FAST_MAX){
+        ptr = malloc(size);
+        if (ptr) {
+            memset(ptr, 0, size);
+        }
+        return ptr;
     }
-    //check if theres room for free blocks in the list
-    if(segfree_list[listpos] == NULL){
-        dbg_printf("Found Space in segfree_list at position: %d\n", listpos);
-    }else{
-        //Free block exist in the free list
-        if(!GET_ALLOC(HDRP(heap_listp))){
-            dbg_printf("The free block at %p is in the free list!\n", HDRP(heap_listp));
+    mm_checkheap(__LINE__);
+    if(size >= MMAP_THRESHOLD){
+        return map_alloc(DSIZE, size);
+    }
+    heap_lock(arena_home());
+    meta->fresh = NULL;
+    ptr = alloc_block(align(size + WSIZE));
+    fresh = (ptr != NULL && ptr == meta->fresh);
+    heap_unlock();
+    if(ptr == NULL){
+        return NULL;
+    }
+    if(!fresh){
+        memset(ptr, 0, size);
+        return ptr;
+    }
+    //The links at the front, and the footer when the whole block was taken
+    end = (char *)ptr + GET_SIZE(HDRP(ptr)) - WSIZE;
+    memset(ptr, 0, 3*WSIZE);
+    memset(end - WSIZE, 0, WSIZE);
+    return ptr;
+}
+
+/*
+ * memalign
+ * Allocates size bytes at a multiple of alignment, a power of two. Up to
+ * ALIGNMENT every payload qualifies, so malloc serves the request. Beyond
+ * it the block is cut from a fit large enough to hold an aligned payload
+ * and the leading gap is freed, leaving an ordinary block that free and
+ * realloc treat like any other. Huge requests get a mapping with room
+ * to push the payload up to an aligned address.
+ */
+void *mm_memalign(size_t alignment, size_t size)
+{
+    void *ptr;
+    mm_checkheap(__LINE__);
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0){
+        return NULL;
+    }
+    if(alignment <= ALIGNMENT){
+        return malloc(size);
+    }
+    //Nothing that large could be placed, and the fit size would overflow
+    if(size == 0 || size > SIZE_MAX - alignment - 2 * DSIZE){
+        return NULL;
+    }
+#ifdef COMPACT
+    //A mapped block's gap before its payload has to fit a 32 bit header
+    if(alignment > COMPACT_MAX){
+        return NULL;
+    }
+#endif
+    if(size >= MMAP_THRESHOLD){
+        return map_alloc(alignment, size);
+    }
+    heap_lock(arena_home());
+    ptr = alloc_aligned(alignment, align(size + WSIZE));
+    heap_unlock();
+    return ptr;
+}
+
+/*
+ * posix memalign
+ * memalign reporting through an error code, alignment must also be a
+ * multiple of the pointer size
+ */
+int mm_posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+    void *ptr;
+    if(alignment == 0 || alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0){
+        return EINVAL;
+    }
+    if(size == 0){
+        *memptr = NULL;
+        return 0;
+    }
+    if((ptr = mm_memalign(alignment, size)) == NULL){
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+/*
+ * aligned alloc
+ * The C11 spelling of memalign
+ */
+void *mm_aligned_alloc(size_t alignment, size_t size)
+{
+    return mm_memalign(alignment, size);
+}
+
+/*
+ * malloc hint
+ * Allocates size bytes like malloc, told how long the block will live.
+ * Short-lived blocks come from the high end of the heap and long-lived
+ * ones from the usual low fits, so freeing the temporaries leaves one
+ * hole rather than many between long-lived blocks. Slots and mapped
+ * blocks live apart already and ignore the hint, as do both hints at once.
+ */
+void *mm_malloc_hint(size_t size, int hint)
+{
+    void *ptr;
+    if(hint != MM_SHORT_LIVED || size == 0 || size >= MMAP_THRESHOLD){
+        return malloc(size);
+    }
+#ifdef SLAB
+    if(size <= SLAB_MAX){
+        return malloc(size);
+    }
+#endif
+    mm_checkheap(__LINE__);
+    heap_lock(arena_home());
+    ptr = alloc_short(align(size + WSIZE));
+    heap_unlock();
+    return ptr;
+}
+
+/*
+ * malloc batch
+ * Allocates n blocks of size bytes into out under a single lock, cutting
+ * them back to back from one fit where it can. Returns how many it
+ * allocated, fewer than n only when the heap runs out.
+ */
+size_t mm_malloc_batch(size_t size, size_t n, void **out)
+{
+    size_t got;
+    mm_checkheap(__LINE__);
+    if(size == 0){
+        return 0;
+    }
+    heap_lock(arena_home());
+    got = heap_malloc_batch(size, n, out);
+    heap_unlock();
+    return got;
+}
+
+/*
+ * Sorts n block pointers by address. Batches are short and often close
+ * to sorted, or sorted backwards when freed in allocation order reversed,
+ * so an insertion sort after flipping a descending batch beats qsort.
+ */
+static void sort_ptrs(void **ptrs, size_t n){
+    void *ptr;
+    size_t i, j;
+    if(n > 1 && ptrs[0] > ptrs[n - 1]){
+        for(i = 0, j = n - 1; i < j; i++, j--){
+            ptr = ptrs[i];
+            ptrs[i] = ptrs[j];
+            ptrs[j] = ptr;
+        }
+    }
+    for(i = 1; i < n; i++){
+        ptr = ptrs[i];
+        for(j = i; j > 0 && ptrs[j - 1] > ptr; j--){
+            ptrs[j] = ptrs[j - 1];
+        }
+        ptrs[j] = ptr;
+    }
+}
+
+/*
+ * free batch
+ * Frees n blocks at once. Slots and mapped blocks go back as they come.
+ * The ordinary blocks are gathered at the front of ptrs and sorted by
+ * address, so blocks lying back to back in the heap are folded into one
+ * and freed, and coalesce, once. Consecutive blocks of one arena share
+ * a lock. The caller's ptrs is the scratch space, its contents are lost.
+ */
+void mm_free_batch(void **ptrs, size_t n)
+{
+    heap_meta_t *arena = NULL;
+    void *ptr;
+    void *last;
+    size_t i, m, size;
+    mm_checkheap(__LINE__);
+    for(i = 0, m = 0; i < n; i++){
+        if((ptr = ptrs[i]) == NULL){
+            continue;
+        }
+#ifdef SLAB
+        if(in_slab(ptr)){
+            arena = relock(arena, arena_of(ptr));
+            slab_free(ptr);
+            continue;
+        }
+#endif
+        if(GET(HDRP(ptr)) & MAPPED){
+            map_free(ptr);
+            continue;
+        }
+        ptrs[m++] = ptr;
+    }
+    sort_ptrs(ptrs, m);
+    for(i = 0; i < m; i++){
+        ptr = ptrs[i];
+        arena = relock(arena, arena_of(ptr));
+        size = GET_SIZE(HDRP(ptr));
+        for(last = ptr; i + 1 < m && ptrs[i + 1] == NEXT_BLKP(last); ){
+            last = ptrs[++i];
+            size += GET_SIZE(HDRP(last));
+        }
+        if(last == ptr){
+            heap_free(ptr);
+            continue;
+        }
+        PUT(HDRP(ptr), PACK(size, GET_PREV_BITS(HDRP(ptr)) | 1));
+        SET_PREV_MINI(HDRP(NEXT_BLKP(ptr)), 0);
+        free_block(ptr, size);
+    }
+    if(arena != NULL){
+        heap_unlock();
+    }
+}
+
+/*
+ * Returns whether the pointer is in the heap of the current arena.
+ * May be useful for debugging.
+ */
+static bool in_heap(const void* p)
+{
+    return p <= mm_region_hi(meta->region) && p >= mm_region_lo(meta->region);
+}
+
+/*
+ * Returns whether the pointer is aligned.
+ * May be useful for debugging.
+ */
+static bool aligned(const void* p)
+{
+    size_t ip = (size_t) p;
+    return align(ip) == ip;
+}
+
+#if defined(DEBUG) && defined(TREE_LIST)
+/*
+ * Checks the subtree at node holds free tree-sized blocks strictly
+ * between lo and hi (NULL for unbounded) with correct AVL heights.
+ * Returns the number of nodes, or -1 after reporting a problem.
+ */
+static long check_tree(void *node, void *lo, void *hi, int lineno){
+    long left, right;
+    size_t hl, hr;
+
+    if(node == NULL){
+        return 0;
+    }
+    if(!in_heap(node) || GET_ALLOC(HDRP(node))
+       || findList(GET_SIZE(HDRP(node))) != TREE_LIST
+       || (lo != NULL && !tree_less(lo, node)) || (hi != NULL && !tree_less(node, hi))){
+        dbg_printf("ERROR (line %d): bad node %p in tree\n", lineno, node);
+        return -1;
+    }
+    if((left = check_tree(LEFT(node), lo, node, lineno)) < 0
+       || (right = check_tree(RIGHT(node), node, hi, lineno)) < 0){
+        return -1;
+    }
+    hl = HEIGHT(LEFT(node));
+    hr = HEIGHT(RIGHT(node));
+    if(HEIGHT(node) != MAX(hl, hr) + 1 || hl > hr + 1 || hr > hl + 1){
+        dbg_printf("ERROR (line %d): tree node %p out of balance\n", lineno, node);
+        return -1;
+    }
+    return left + right + 1;
+}
+#endif
+
+#ifdef DEBUG
+/*
+ * check_heap
+ * Walks the heap block by block and then every free list and the tree,
+ * checking boundary tags, prev-alloc and prev-mini bits, coalescing,
+ * list membership, tree order and balance, the classmap and the
+ * fastbins. Reports
+ * the first problem found with the caller's line.
+ */
+static bool check_heap(int lineno)
+{
+    char *heap_listp = (char *)meta + align(sizeof(heap_meta_t)) + DSIZE; //the arena's prologue
+    int listpos;
+    char *ptr;
+    size_t prev_alloc = PREV_ALLOC;
+    size_t prev_mini = 0;
+    bool marked;
+    size_t heap_nfree = 0;
+    size_t list_nfree = 0;
+
+    //Check the prologue
+    if(GET_SIZE(HDRP(heap_listp)) != DSIZE || !GET_ALLOC(HDRP(heap_listp))){
+        dbg_printf("ERROR (line %d): bad prologue header\n", lineno);
+        return false;
+    }
+    //Check every block up to the epilogue
+    for(ptr = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(ptr)) > 0; ptr = NEXT_BLKP(ptr)){
+        if(!in_heap(ptr) || !aligned(ptr)){
+            dbg_printf("ERROR (line %d): block %p misplaced or misaligned\n", lineno, ptr);
+            return false;
+        }
+        if(GET_PREV_ALLOC(HDRP(ptr)) != prev_alloc || GET_PREV_MINI(HDRP(ptr)) != prev_mini){
+            dbg_printf("ERROR (line %d): block %p has stale prev bits\n", lineno, ptr);
+            return false;
+        }
+        if(!GET_ALLOC(HDRP(ptr))){
+            //check if the header size match with the footer size
+            if(GET_SIZE(HDRP(ptr)) > MINISIZE && GET_SIZE(HDRP(ptr)) != GET_SIZE(FTRP(ptr))){
+                dbg_printf("ERROR (line %d): block %p header and footer differ\n", lineno, ptr);
+                return false;
+            }
+            if(!prev_alloc){
+                dbg_printf("ERROR (line %d): block %p escaped coalescing\n", lineno, ptr);
+                return false;
+            }
+#ifdef TLSF
+            //Free mini-blocks are on no list, only a top one is counted
+            if(GET_SIZE(HDRP(ptr)) > MINISIZE || ptr == meta->top){
+                heap_nfree++;
+            }
+#else
+            heap_nfree++;
+#endif
+        }
+        prev_alloc = GET_ALLOC(HDRP(ptr)) ? PREV_ALLOC : 0;
+        prev_mini = (GET_SIZE(HDRP(ptr)) == MINISIZE) ? PREV_MINI : 0;
+    }
+    //Check the epilogue
+    if(!GET_ALLOC(HDRP(ptr)) || GET_PREV_ALLOC(HDRP(ptr)) != prev_alloc
+       || GET_PREV_MINI(HDRP(ptr)) != prev_mini
+       || (char *)ptr - 1 != (char *)mm_region_hi(meta->region)){
+        dbg_printf("ERROR (line %d): bad epilogue header\n", lineno);
+        return false;
+    }
+    //Check the top block is the free last block, if any, and the clean top still zero
+    if(meta->top != (prev_alloc ? NULL : PREV_BLKP(ptr))){
+        dbg_printf("ERROR (line %d): top %p is not the free last block\n", lineno, meta->top);
+        return false;
+    }
+    if(meta->top != NULL){
+        list_nfree++;
+    }
+    if(meta->clean_top != NULL){
+        char *p;
+        if(meta->clean_top != meta->top){
+            dbg_printf("ERROR (line %d): clean top %p is not the top block\n",
+                       lineno, meta->clean_top);
+            return false;
+        }
+        for(p = (char *)meta->clean_top + 3*WSIZE; p < FTRP(meta->clean_top); p += WSIZE){
+            if(GET(p) != 0){
+                dbg_printf("ERROR (line %d): clean top %p is dirty at %p\n",
+                           lineno, meta->clean_top, p);
+                return false;
+            }
+        }
+    }
+    //Check every free list node and the classmap
+    for(ptr = meta->mini_list; ptr != NULL; ptr = PREV(ptr)){
+        if(!in_heap(ptr) || GET_ALLOC(HDRP(ptr)) || GET_SIZE(HDRP(ptr)) != MINISIZE){
+            dbg_printf("ERROR (line %d): bad node %p in mini_list\n", lineno, ptr);
+            return false;
+        }
+        list_nfree++;
+    }
+    for(listpos = 0; listpos < totalTrace; listpos++){
+#ifdef TLSF
+        marked = ((meta->sl_map[listpos / SL_COUNT] >> (listpos % SL_COUNT)) & 1)
+                 && ((meta->fl_map >> (listpos / SL_COUNT)) & 1);
+#else
+        marked = (meta->classmap >> listpos) & 1;
+#endif
+        if(marked != (meta->segfree_list[listpos] != NULL)){
+            dbg_printf("ERROR (line %d): list bitmap bit %d disagrees with segfree_list\n",
+                       lineno, listpos);
+            return false;
+        }
+#ifdef TREE_LIST
+        if(listpos == TREE_LIST){
+            long nodes = check_tree(meta->segfree_list[listpos], NULL, NULL, lineno);
+            if(nodes < 0){
+                return false;
+            }
+            list_nfree += nodes;
+            continue;
+        }
+#endif
+        for(ptr = meta->segfree_list[listpos]; ptr != NULL; ptr = PREV(ptr)){
+            if(!in_heap(ptr) || GET_ALLOC(HDRP(ptr))
+               || findList(GET_SIZE(HDRP(ptr))) != listpos){
+                dbg_printf("ERROR (line %d): bad node %p in list %d\n", lineno, ptr, listpos);
+                return false;
+            }
+            if(PREV(ptr) != NULL && NEXT(PREV(ptr)) != ptr){
+                dbg_printf("ERROR (line %d): broken links at %p\n", lineno, ptr);
+                return false;
+            }
+            list_nfree++;
         }
-        //check if the header size match with the footer size
-        if(GET_SIZE(HDRP(heap_listp)) != GET_SIZE(FTRP(heap_listp))){
-            dbg_printf("Pointer: %p Header size doesn't equal to the footer size\n", HDRP(heap_listp));
-            heap_listp = NEXT_BLKP(heap_listp);
+    }
+    if(heap_nfree != list_nfree){
+        dbg_printf("ERROR (line %d): %zu free blocks in heap, %zu in lists\n",
+                   lineno, heap_nfree, list_nfree);
+        return false;
+    }
+    //Check every fastbin holds allocated blocks of its own size, and the fastmap
+    for(listpos = 0; listpos < FAST_BINS; listpos++){
+        if(((meta->fastmap >> listpos) & 1) != (meta->fastbins[listpos] != NULL)){
+            dbg_printf("ERROR (line %d): fastmap bit %d disagrees with fastbins\n",
+                       lineno, listpos);
+            return false;
+        }
+        for(ptr = meta->fastbins[listpos]; ptr != NULL; ptr = PREV(ptr)){
+            if(!in_heap(ptr) || !GET_ALLOC(HDRP(ptr))
+               || GET_SIZE(HDRP(ptr)) != (size_t)(listpos + 1) * DSIZE){
+                dbg_printf("ERROR (line %d): bad block %p in fastbin %d\n", lineno, ptr, listpos);
+                return false;
+            }
+        }
+    }
+#ifdef SLAB
+    //Check every run with free slots is mapped and counts its slots right
+    for(listpos = 0; listpos < SLAB_CLASSES; listpos++){
+        for(run_t *run = meta->slab_runs[listpos]; run != NULL; run = run->next){
+            int nfree = 0;
+            for(int w = 0; w < 4; w++){
+                nfree += __builtin_popcountll(run->freemap[w]);
+            }
+            if(!in_slab(run) || run->slot != (size_t)(listpos + 1) * DSIZE
+               || run->nfree == 0 || (int)run->nfree != nfree){
+                dbg_printf("ERROR (line %d): bad run %p in class %d\n", lineno, run, listpos);
+                return false;
+            }
         }
     }
+#endif
+    return true;
+}
 #endif // DEBUG
+
+/*
+ * mm_checkheap
+ * Runs check_heap on every arena under its lock, so other threads hold still
+ */
+bool mm_checkheap(int lineno)
+{
+#ifdef DEBUG
+    heap_meta_t *arena;
+    bool ok = true;
+    //Nothing to check before mm_init has laid out the heap
+    if(mm_heapsize() == 0){
+        return true;
+    }
+    for(int region = 0; ok && region < MM_ARENAS; region++){
+        arena = mm_region_lo(region);
+        //Arenas no thread has been handed yet are not laid out
+        if((char *)mm_region_hi(region) + 1 == (char *)arena){
+            continue;
+        }
+        heap_lock(arena);
+        ok = check_heap(lineno);
+        heap_unlock();
+    }
+    return ok;
+#else
     return true;
+#endif // DEBUG
 }
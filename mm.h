@@ -21,5 +21,45 @@ extern void *calloc (size_t nmemb, size_t size);
 
 extern bool mm_init(void);
 
+/* discard every allocation at once, leaving the heap as mm_init does */
+extern bool mm_reset(void);
+
+/* scoped arenas bumped out of the heap, their blocks all freed at once */
+typedef struct mm_arena mm_arena_t;
+extern mm_arena_t *mm_arena_create(size_t size);
+extern void *mm_arena_alloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/* pools of same-size objects carved from chunks of the heap */
+typedef struct mm_pool mm_pool_t;
+extern mm_pool_t *mm_pool_create(size_t object_size, size_t alignment);
+extern void *mm_pool_alloc(mm_pool_t *pool);
+extern void mm_pool_free(mm_pool_t *pool, void *ptr);
+extern void mm_pool_destroy(mm_pool_t *pool);
+
+/* allocate a block told whether it is freed soon or kept */
+#define MM_SHORT_LIVED 1
+#define MM_LONG_LIVED 2
+extern void *mm_malloc_hint(size_t size, int hint);
+
+/* allocate or free many blocks in one call, mm_free_batch clobbers ptrs */
+extern size_t mm_malloc_batch(size_t size, size_t n, void **out);
+extern void mm_free_batch(void **ptrs, size_t n);
+
+/* free a block given the size it was last requested with */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/* bytes of the block at ptr the caller may use, at least what it asked for */
+extern size_t mm_usable_size(void *ptr);
+
+/* blocks a size class is searched for a fit, size 0 for every class */
+extern int mm_fit_scan(size_t size, unsigned k);
+
+/* allocate a block whose address is a multiple of alignment */
+extern void *mm_memalign(size_t alignment, size_t size);
+extern int mm_posix_memalign(void **memptr, size_t alignment, size_t size);
+extern void *mm_aligned_alloc(size_t alignment, size_t size);
+
 /* This is for debugging.  Returns false if error encountered */
 extern bool mm_checkheap(int lineno);
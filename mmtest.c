@@ -0,0 +1,304 @@
+/*
+ * mmtest.c - Tests for the parts of the mm package that mdriver does not
+ *     reach. Built with THREADS and DEBUG by "make check", so every call
+ *     runs the heap checker.
+ *
+ *     The thread test runs NUM_THREADS threads, more than there are
+ *     memlib regions so arenas are shared, that pass blocks to each other
+ *     through a table of slots. Most blocks are freed by another thread
+ *     than the one that allocated them, often in another arena, and every
+ *     thread exits with a full thread cache for its destructor to drain.
+ *
+ *     The memalign test checks that mm_posix_memalign turns down bad
+ *     alignments with EINVAL and places good ones.
+ *
+ *     The scoped arena test starts from a heap emptied by mm_reset. It
+ *     fills an arena, resets it and fills it again with the same sizes a
+ *     few times before destroying it, and checks the heap grows by no
+ *     more than the free top the allocator may keep after the first time
+ *     round.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define NUM_THREADS 16     /* threads per round, twice MEM_REGIONS */
+#define NUM_ROUNDS 4       /* rounds of threads, each round new threads */
+#define NUM_OPS 2000       /* mallocs each thread makes per round */
+#define NUM_SLOTS 64       /* slots blocks are handed over through */
+#define HUGE_SIZE (300 * 1024) /* big enough to be mapped */
+#define ARENA_ROUNDS 4     /* scoped arenas created and destroyed */
+#define ARENA_BLOCKS 512   /* blocks taken from each fill of an arena */
+#define ARENA_BIG (40 * 1024) /* more than a default arena chunk */
+#define ARENA_SLACK (64 * 1024) /* free top left untrimmed, TRIM_THRESHOLD */
+
+static void *slots[NUM_SLOTS];
+static int failures = 0;
+
+/*
+ * fail - Report a failed check
+ */
+static void fail(const char *msg, const void *ptr)
+{
+    __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+    fprintf(stderr, "FAILED: %s (%p)\n", msg, ptr);
+}
+
+/*
+ * fill_block - Write the size of the block into its first word and a
+ *     byte depending on its address into the rest
+ */
+static void fill_block(unsigned char *p, size_t size)
+{
+    memcpy(p, &size, sizeof(size));
+    memset(p + sizeof(size), (int)((uintptr_t)p >> 4) & 0xff,
+           size - sizeof(size));
+}
+
+/*
+ * check_block - Check that a block still holds what fill_block wrote
+ */
+static void check_block(unsigned char *p)
+{
+    size_t size, i;
+
+    memcpy(&size, p, sizeof(size));
+    for (i = sizeof(size); i < size; i++) {
+        if (p[i] != (((uintptr_t)p >> 4) & 0xff)) {
+            fail("block overwritten", p);
+            break;
+        }
+    }
+}
+
+/*
+ * check_free - Check a block and free it
+ */
+static void check_free(unsigned char *p)
+{
+    check_block(p);
+    mm_free(p);
+}
+
+/*
+ * block_size - Mostly thread cache sizes, some ordinary blocks and
+ *     now and then a mapped one
+ */
+static size_t block_size(unsigned *seed)
+{
+    unsigned r = rand_r(seed);
+
+    if (r % 256 == 0)
+        return HUGE_SIZE;
+    if (r % 4 == 0)
+        return 16 + r % 4000;
+    return 16 + r % 240;
+}
+
+/*
+ * thread_main - Allocate blocks and either free them or swap them for
+ *     whatever block another thread left in a slot
+ */
+static void *thread_main(void *arg)
+{
+    unsigned seed = (unsigned)(uintptr_t)arg;
+    void *kept[16] = { NULL };
+    unsigned char *p, *old;
+    size_t size;
+    int i, k;
+
+    for (i = 0; i < NUM_OPS; i++) {
+        size = block_size(&seed);
+        if ((p = mm_malloc(size)) == NULL) {
+            fail("mm_malloc returned NULL", NULL);
+            return NULL;
+        }
+        fill_block(p, size);
+        k = rand_r(&seed) % 3;
+        if (k == 0) {
+            check_free(p);
+        } else if (k == 1) {
+            old = __atomic_exchange_n(&slots[rand_r(&seed) % NUM_SLOTS],
+                                      p, __ATOMIC_ACQ_REL);
+            if (old != NULL)
+                check_free(old);
+        } else {
+            k = rand_r(&seed) % 16;
+            if (kept[k] != NULL)
+                check_free(kept[k]);
+            kept[k] = p;
+        }
+    }
+    /* Hand what is left to the other threads, the cache drains at exit */
+    for (k = 0; k < 16; k++) {
+        if (kept[k] == NULL)
+            continue;
+        old = __atomic_exchange_n(&slots[k], kept[k], __ATOMIC_ACQ_REL);
+        if (old != NULL)
+            check_free(old);
+    }
+    return NULL;
+}
+
+/*
+ * test_threads - Run the rounds of threads, then free what is left in
+ *     the slots and check the heap
+ */
+static void test_threads(void)
+{
+    pthread_t threads[NUM_THREADS];
+    int round, i;
+
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        for (i = 0; i < NUM_THREADS; i++) {
+            if (pthread_create(&threads[i], NULL, thread_main,
+                               (void *)(uintptr_t)(round * NUM_THREADS + i + 1)) != 0) {
+                fail("pthread_create", NULL);
+                return;
+            }
+        }
+        for (i = 0; i < NUM_THREADS; i++)
+            pthread_join(threads[i], NULL);
+        if (!mm_checkheap(__LINE__))
+            fail("mm_checkheap after a round of threads", NULL);
+    }
+    /* Threads are handed arenas in turn, so every region holds one */
+    for (i = 0; i < MEM_REGIONS; i++) {
+        if ((char *)mm_region_hi(i) + 1 == (char *)mm_region_lo(i))
+            fail("region without an arena", mm_region_lo(i));
+    }
+    for (i = 0; i < NUM_SLOTS; i++) {
+        if (slots[i] != NULL)
+            check_free(slots[i]);
+        slots[i] = NULL;
+    }
+    if (!mm_checkheap(__LINE__))
+        fail("mm_checkheap after freeing every block", NULL);
+    if (mm_mapsize() != 0)
+        fail("mapped blocks left after freeing every block", NULL);
+}
+
+/*
+ * test_memalign - Check what mm_posix_memalign returns for alignments
+ *     that are zero, not a multiple of a pointer or not a power of two,
+ *     and that the blocks it does give are aligned
+ */
+static void test_memalign(void)
+{
+    static const size_t bad[] = { 0, 4, 24, 3 * sizeof(void *) };
+    void *p;
+    size_t align;
+    size_t i;
+
+    for (i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        p = &p;
+        if (mm_posix_memalign(&p, bad[i], 64) != EINVAL)
+            fail("mm_posix_memalign accepted a bad alignment", NULL);
+        if (p != &p)
+            fail("mm_posix_memalign set memptr on failure", p);
+    }
+    for (align = sizeof(void *); align <= 65536; align *= 2) {
+        if (mm_posix_memalign(&p, align, 100) != 0) {
+            fail("mm_posix_memalign failed", NULL);
+            continue;
+        }
+        if ((uintptr_t)p % align != 0)
+            fail("mm_posix_memalign block not aligned", p);
+        mm_free(p);
+    }
+    if (!mm_checkheap(__LINE__))
+        fail("mm_checkheap after mm_posix_memalign", NULL);
+}
+
+/*
+ * fill_arena - Take ARENA_BLOCKS blocks from a scoped arena, one of them
+ *     bigger than a chunk, and check none of them overlap
+ */
+static void fill_arena(mm_arena_t *arena, unsigned *seed)
+{
+    unsigned char *blocks[ARENA_BLOCKS];
+    size_t size;
+    int i;
+
+    for (i = 0; i < ARENA_BLOCKS; i++) {
+        size = (i == ARENA_BLOCKS / 2) ? ARENA_BIG : 16 + rand_r(seed) % 1000;
+        if ((blocks[i] = mm_arena_alloc(arena, size)) == NULL) {
+            fail("mm_arena_alloc returned NULL", NULL);
+            return;
+        }
+        if ((uintptr_t)blocks[i] % 16 != 0)
+            fail("mm_arena_alloc block not aligned", blocks[i]);
+        fill_block(blocks[i], size);
+    }
+    for (i = 0; i < ARENA_BLOCKS; i++)
+        check_block(blocks[i]);
+}
+
+/*
+ * test_arenas - Fill, reset and refill scoped arenas, destroy them and
+ *     check the heap they came from
+ */
+static void test_arenas(void)
+{
+    unsigned seed;
+    mm_arena_t *arena;
+    size_t heapsize = 0;
+    int round;
+
+    /* Start where the earlier tests left nothing behind */
+    if (!mm_reset()) {
+        fail("mm_reset failed", NULL);
+        return;
+    }
+    if ((arena = mm_arena_create(0)) != NULL) {
+        if (mm_arena_alloc(arena, 0) != NULL)
+            fail("mm_arena_alloc gave a block for 0 bytes", NULL);
+        mm_arena_destroy(arena);
+    }
+    for (round = 0; round < ARENA_ROUNDS; round++) {
+        if ((arena = mm_arena_create(0)) == NULL) {
+            fail("mm_arena_create returned NULL", NULL);
+            return;
+        }
+        seed = 1;
+        fill_arena(arena, &seed);
+        mm_arena_reset(arena);
+        fill_arena(arena, &seed);
+        mm_arena_destroy(arena);
+        if (!mm_checkheap(__LINE__))
+            fail("mm_checkheap after destroying a scoped arena", NULL);
+        /* Every chunk went back, the next arena fits where it was */
+        if (round == 0)
+            heapsize = mm_heapsize();
+        else if (mm_heapsize() > heapsize + ARENA_SLACK)
+            fail("heap grew after destroying a scoped arena", NULL);
+    }
+}
+
+int main(void)
+{
+    mem_init();
+    if (!mm_init()) {
+        fprintf(stderr, "mm_init failed\n");
+        return 1;
+    }
+
+    test_threads();
+    test_memalign();
+    test_arenas();
+
+    mem_deinit();
+    if (failures) {
+        printf("mmtest: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("mmtest: all checks passed\n");
+    return 0;
+}